@@ -43,11 +43,105 @@ cdef extern from "driver.h":
         pass
     ctypedef struct cpl:
         pass
+    enum: IOWORKER_LATENCY_BUCKETS
+    ctypedef struct buffer_pool_stats:
+        unsigned long hit
+        unsigned long miss
+        unsigned long recycle
+        unsigned long release
+        unsigned long cached_bytes
+    ctypedef struct ioworker_latency:
+        unsigned long count
+        unsigned long min_ns
+        unsigned long max_ns
+        unsigned long sum_ns
+        double sum_sq_ns
+        unsigned long bucket[IOWORKER_LATENCY_BUCKETS]
+    enum: IOWORKER_PHASE_MAX
+    ctypedef struct ioworker_phase:
+        unsigned int mseconds
+        unsigned int iops
+        unsigned short read_percentage
+        unsigned int qdepth
+        unsigned long io_count_read
+        unsigned long io_count_write
+        unsigned long latency_sum_ns
+        unsigned long latency_max_ns
+    enum: IOWORKER_LBA_SEQUENTIAL
+    enum: IOWORKER_LBA_UNIFORM
+    enum: IOWORKER_LBA_ZIPF
+    enum: IOWORKER_LBA_PARETO
+    enum: IOWORKER_LBA_HOTCOLD
+    enum: IOWORKER_LBA_GAUSSIAN
+    enum: IOWORKER_SIZE_MAX
+    ctypedef struct ioworker_size:
+        unsigned short lba_size
+        unsigned short lba_align
+        unsigned int weight
+        unsigned long io_count
+        unsigned long io_bytes
+        unsigned long latency_sum_ns
+        unsigned long latency_max_ns
+    enum: IOWORKER_OP_READ
+    enum: IOWORKER_OP_WRITE
+    enum: IOWORKER_OP_TRIM
+    enum: IOWORKER_OP_WRITE_ZEROES
+    enum: IOWORKER_OP_FLUSH
+    enum: IOWORKER_OP_COMPARE
+    enum: IOWORKER_OP_MAX
+    ctypedef struct ioworker_op:
+        unsigned int weight
+        unsigned long io_count
+        unsigned long error_count
+        unsigned long latency_sum_ns
+        unsigned long latency_max_ns
+    enum: IOWORKER_STREAM_MAX
+    ctypedef struct ioworker_stream:
+        unsigned long region_start
+        unsigned long region_end
+        unsigned int weight
+        unsigned long lba
+        unsigned long io_count
+    enum: IOWORKER_PERCENTILE_MAX
+    ctypedef struct ioworker_output:
+        ioworker_latency latency_read
+        ioworker_latency latency_write
+        unsigned int percentile_count
+        double percentiles[IOWORKER_PERCENTILE_MAX]
+        unsigned long percentile_latency_ns[IOWORKER_PERCENTILE_MAX]
+        unsigned int phase_count
+        unsigned int phase_once
+        ioworker_phase phases[IOWORKER_PHASE_MAX]
+        unsigned int size_count
+        ioworker_size sizes[IOWORKER_SIZE_MAX]
+        unsigned int stream_count
+        ioworker_stream streams[IOWORKER_STREAM_MAX]
+        ioworker_op ops[IOWORKER_OP_MAX]
+        unsigned int seconds
+        unsigned int io_counter_per_second[1]
+    ctypedef struct ioworker_progress:
+        unsigned int mseconds
+        unsigned int iops
+        unsigned int iops_read
+        unsigned int iops_write
+        unsigned long bandwidth
+        unsigned long io_count_read
+        unsigned long io_count_write
+        unsigned long latency_p50_ns
+        unsigned long latency_p99_ns
+        unsigned long latency_max_ns
+        unsigned short error
+        unsigned char finished
     ctypedef struct ioworker_args:
         unsigned long lba_start
         unsigned short lba_size
         unsigned short lba_align
-        bint lba_random
+        int lba_random
+        double lba_theta
+        double lba_hot_fraction
+        double lba_hot_probability
+        double lba_center
+        double lba_sigma
         unsigned long region_start
         unsigned long region_end
         unsigned short read_percentage
@@ -56,24 +150,59 @@ cdef extern from "driver.h":
         unsigned int seconds
         unsigned int qdepth
         unsigned int* io_counter_per_second
-        unsigned int* io_counter_per_latency
+        ioworker_latency* latency_read
+        ioworker_latency* latency_write
+        double* percentiles
+        unsigned long* percentile_latency_ns
+        unsigned int percentile_count
         unsigned int wid
+        unsigned int verify_threads
+        void* progress
+        unsigned int progress_interval_ms
+        ioworker_phase* phases
+        unsigned int phase_count
+        unsigned int phase_once
+        ioworker_size* sizes
+        unsigned int size_count
+        ioworker_stream* streams
+        unsigned int stream_count
+        ioworker_op* ops
+        unsigned long seed
     ctypedef struct ioworker_rets:
         unsigned long io_count_read
         unsigned long io_count_write
         unsigned int mseconds
         unsigned int latency_max_us
+        unsigned long latency_average_ns
+        unsigned long latency_stddev_ns
+        unsigned long latency_read_average_ns
+        unsigned long latency_write_average_ns
+        unsigned long seed
+        int core
+        int numa_node
+        int device_numa_node
         unsigned short error
+        ioworker_op ops[IOWORKER_OP_MAX]
     ctypedef struct ioworker_status:
         unsigned long io_count_sent
         unsigned long io_count_cplt
 
     ctypedef void(*cmd_cb_func)(void * cmd_cb_arg, const cpl * cpl)
+    ctypedef struct cpl_batch_entry:
+        unsigned short cid
+        unsigned short status
+        unsigned int cdw0
+        unsigned int latency
+    ctypedef struct cpl_batch:
+        cmd_cb_func cb_fn
+        cpl_batch_entry* entries
+        unsigned int size
+        unsigned int count
     ctypedef void(*aer_cb_func)(void * are_cb_arg, const cpl * cpl)
     ctypedef void(*timeout_cb_func)(void * cb_arg, ctrlr * ctrlr,
                                     qpair * qpair, unsigned short cid)
 
-    int driver_init()
+    int driver_init(int core)
     int driver_probe()
     int driver_fini()
 
@@ -95,6 +224,10 @@ cdef extern from "driver.h":
                        unsigned int offset,
                        unsigned int * value)
     int nvme_wait_completion_admin(ctrlr * c)
+    int nvme_wait_completion_admin_timed(ctrlr * c,
+                                         unsigned int expected,
+                                         unsigned int usec) nogil
+    int nvme_wait_completion_admin_batch(ctrlr * c, cpl_batch * batch) nogil
     void nvme_cmd_cb_print_cpl(void * qpair, const cpl * cpl)
     int nvme_send_cmd_raw(ctrlr * c,
                           qpair * qpair,
@@ -119,14 +252,23 @@ cdef extern from "driver.h":
                                   unsigned int timeout)
 
     void * buffer_init(size_t bytes, unsigned long* phys_addr)
-    void buffer_fini(void * buf)
+    void buffer_fini(void * buf, size_t bytes, unsigned long phys_addr)
+    void buffer_pool_get_stats(buffer_pool_stats* stats)
+    unsigned long crc32c_benchmark(void * buf, size_t len,
+                                   unsigned int loops, bint vectorized)
 
     qpair * qpair_create(ctrlr * c, int prio, int depth)
     int qpair_wait_completion(qpair * q, unsigned int max_completions)
+    int qpair_wait_completion_timed(qpair * q,
+                                    unsigned int expected,
+                                    unsigned int usec) nogil
+    int qpair_wait_completion_batch(qpair * q,
+                                    unsigned int max_completions,
+                                    cpl_batch * batch) nogil
     int qpair_get_id(qpair * q)
     int qpair_free(qpair * q)
 
-    namespace * ns_init(ctrlr * c, unsigned int nsid)
+    namespace * ns_init(ctrlr * c, unsigned int nsid, unsigned int crc_width)
     int ns_cmd_read_write(bint is_read,
                           namespace * ns,
                           qpair * qpair,
@@ -137,16 +279,53 @@ cdef extern from "driver.h":
                           unsigned int io_flags,
                           cmd_cb_func cb_fn,
                           void * cb_arg)
+    int ns_cmd_batch(namespace * ns,
+                     qpair * qpair,
+                     void * buf,
+                     size_t len,
+                     unsigned int count,
+                     const unsigned char * ops,
+                     const unsigned long * lbas,
+                     const unsigned short * lba_counts,
+                     const unsigned long * offsets,
+                     unsigned int qdepth,
+                     unsigned int timeout,
+                     unsigned short * status,
+                     unsigned int * latency) nogil
+    unsigned int ns_cmd_batch_orphans()
     unsigned int ns_get_sector_size(namespace * ns)
     unsigned long ns_get_num_sectors(namespace * ns)
     int ns_fini(namespace * ns)
     
     void crc32_clear(unsigned long lba, unsigned long lba_count, bint sanitize, bint uncorr)
+    int crc32_save(const char* path, const char* serial,
+                   unsigned int nsid, unsigned int lbaf)
+    int crc32_load(const char* path, const char* serial,
+                   unsigned int nsid, unsigned int lbaf)
     ioworker_status ioworker_get_status(unsigned int wid)
     int ioworker_entry(namespace* ns,
                        qpair* qpair,
                        ioworker_args* args,
-                       ioworker_rets* rets)
+                       ioworker_rets* rets) nogil
+    int ioworker_reactor(unsigned int count,
+                         namespace** ns,
+                         qpair** qpairs,
+                         ioworker_args* args,
+                         ioworker_rets* rets,
+                         int* errors,
+                         unsigned int budget)
+    void ioworker_latency_merge(ioworker_latency* dst,
+                                const ioworker_latency* src)
+    unsigned long ioworker_latency_percentile(const ioworker_latency* h,
+                                              double percentile)
+    unsigned long ioworker_latency_bucket_ns(unsigned int index)
+    void* ioworker_progress_init(char* name)
+    void* ioworker_progress_find(char* name)
+    void ioworker_progress_fini(char* name)
+    void ioworker_progress_read(void* progress, ioworker_progress* snapshot)
+    ioworker_output* ioworker_output_init(char* name, unsigned int seconds)
+    ioworker_output* ioworker_output_find(char* name)
+    void ioworker_output_fini(char* name)
 
     void log_buf_dump(const char * header, const void * buf, size_t len)
     void log_cmd_dump(qpair * qpair, size_t count)
@@ -37,8 +37,14 @@
 #include <stdint.h>
 #include <unistd.h>
 #include <string.h>
+#include <math.h>
+#include <fcntl.h>
+#include <sys/mman.h>
 #include <sys/time.h>
 #include <sys/sysinfo.h>
+#ifdef __x86_64__
+#include <x86intrin.h>
+#endif
 
 #include "spdk/stdinc.h"
 #include "spdk/nvme.h"
@@ -49,21 +55,200 @@
 #include "driver.h"
 
 
+#define US_PER_S   (1000ULL*1000ULL)
+#define NS_PER_S   (1000ULL*1000ULL*1000ULL)
+#define MIN(X,Y)   ((X) < (Y) ? (X) : (Y))
+#define MAX(X,Y)   ((X) > (Y) ? (X) : (Y))
+#define ALIGN_UP(n, a)    (((n)%(a))?((n)+(a)-((n)%(a))):((n)))
+#define ALIGN_DOWN(n, a)  ((n)-((n)%(a)))
+
+
 //// lba token
 ///////////////////////////////
 
 #define DRIVER_IO_TOKEN_NAME    "driver_io_token"
-#define DRIVER_CRC32_TABLE_NAME "driver_crc32_table"
+#define DRIVER_CRC32_TABLE_NAME "/driver_crc32_table_%s_%d"
 #define IOWORKER_STATUS_TABLE   "ioworker_status_table"
 #define IOWORKER_STATUS_SLOTS   (64)
+#define DRIVER_IO_TOKEN_LEASE   (1024*1024ULL)
+
+// The checksum table is not DMA-able, so it is kept in an ordinary
+// shared memory object instead of hugepages. The object is sparse: a
+// page of the table is only populated when one of its lba is written.
+// Each table page is tagged with the generation it was populated in.
+// A page tagged with an older generation is stale, and all its lba are
+// treated as no mapping, so the whole table is invalidated by bumping
+// the generation in the header.
+#define CRC32_TABLE_MAGIC       (0x3233435243454d56ULL)  //"VMECRC32"
+#define CRC32_TABLE_PAGE_SIZE   (4096ULL)
+#define CRC32_PAGE_GEN_STALE    (0)
+#define CRC32_PAGE_GEN_BUSY     (0xffffffff)
+#define CRC32_FILE_SYNC_PAGES   (16*1024ULL)
+
+// the same layout is used in the snapshot file, where the device
+// identification binds the table to the namespace it was built on
+struct crc32_table_hdr {
+  uint64_t magic;
+  uint32_t width;
+  uint32_t generation;
+  uint64_t nlba;
+  uint64_t gen_offset;
+  uint64_t table_offset;
+  uint64_t size;
+  uint64_t token;
+  char serial[20];
+  uint32_t nsid;
+  uint32_t lbaf;
+};
+
+// status is updated in every io by different ioworker processes, so each
+// ioworker has its own cacheline to avoid false sharing
+struct ioworker_status_slot {
+  struct ioworker_status sts;
+} __attribute__((aligned(64)));
 
 // TODO: support multiple namespace
 static uint64_t g_driver_table_size = 0;
 static uint64_t* g_driver_io_token_ptr = NULL;
-static uint32_t* g_driver_csum_table_ptr = NULL;
-static struct ioworker_status* g_ioworker_status_table = NULL;
+static __thread uint64_t g_driver_io_token_next = 0;
+static __thread uint64_t g_driver_io_token_end = 0;
+static void* g_driver_csum_table_ptr = NULL;
+static struct ioworker_status_slot* g_ioworker_status_table = NULL;
+
+static struct crc32_table_hdr* g_crc32_table_hdr = NULL;
+static uint32_t* g_crc32_page_gen = NULL;
+static char g_crc32_table_name[64];
+static uint32_t g_crc32_width = 32;
+
+static void token_lease_drop(void)
+{
+  g_driver_io_token_next = 0;
+  g_driver_io_token_end = 0;
+}
+
+static uint64_t token_alloc(uint32_t count)
+{
+  uint64_t token;
+
+  // each thread leases a block of tokens from the shared counter, so
+  // the shared cache line is rarely touched. Tokens are still unique
+  // among all threads of all processes.
+  if (g_driver_io_token_next + count > g_driver_io_token_end)
+  {
+    uint64_t lease = MAX(DRIVER_IO_TOKEN_LEASE, count);
+
+    g_driver_io_token_next = __atomic_fetch_add(g_driver_io_token_ptr,
+                                                lease,
+                                                __ATOMIC_RELAXED);
+    g_driver_io_token_end = g_driver_io_token_next + lease;
+    SPDK_DEBUGLOG(SPDK_LOG_NVME, "lease token: %ld\n", g_driver_io_token_next);
+  }
+
+  token = g_driver_io_token_next;
+  g_driver_io_token_next += count;
+  return token;
+}
+
+static int crc32_table_map(const char* traddr, uint32_t nsid,
+                           uint64_t nlba, uint32_t width)
+{
+  int fd;
+  size_t size;
+  struct stat st;
+  uint64_t table_offset = 0;
+  struct crc32_table_hdr* hdr;
+
+  // one table for each namespace, so sessions of other devices keep theirs
+  snprintf(g_crc32_table_name, sizeof(g_crc32_table_name),
+           DRIVER_CRC32_TABLE_NAME, traddr, nsid);
+
+  if (spdk_process_is_primary())
+  {
+    uint64_t table_size = nlba*(width/8);
+    uint64_t pages = ALIGN_UP(table_size, CRC32_TABLE_PAGE_SIZE)/CRC32_TABLE_PAGE_SIZE;
+    uint64_t gen_size = ALIGN_UP(pages*sizeof(uint32_t), CRC32_TABLE_PAGE_SIZE);
+
+    // the table left by a crashed session is not valid any more
+    shm_unlink(g_crc32_table_name);
+    fd = shm_open(g_crc32_table_name, O_CREAT|O_EXCL|O_RDWR, 0600);
+    if (fd < 0)
+    {
+      SPDK_ERRLOG("fail to create crc32 table: %s\n", strerror(errno));
+      return -1;
+    }
+
+    // ftruncate does not allocate any memory for the table
+    table_offset = CRC32_TABLE_PAGE_SIZE + gen_size;
+    size = table_offset + pages*CRC32_TABLE_PAGE_SIZE;
+    if (ftruncate(fd, size) != 0)
+    {
+      SPDK_ERRLOG("fail to size crc32 table: %s\n", strerror(errno));
+      close(fd);
+      shm_unlink(g_crc32_table_name);
+      return -1;
+    }
+  }
+  else
+  {
+    fd = shm_open(g_crc32_table_name, O_RDWR, 0600);
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+      SPDK_ERRLOG("fail to find crc32 table: %s\n", strerror(errno));
+      return -1;
+    }
+    size = st.st_size;
+  }
+
+  hdr = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_NORESERVE, fd, 0);
+  close(fd);
+  if (hdr == MAP_FAILED)
+  {
+    SPDK_ERRLOG("fail to map crc32 table: %s\n", strerror(errno));
+    return -1;
+  }
+
+  if (spdk_process_is_primary())
+  {
+    hdr->width = width;
+    hdr->generation = 1;
+    hdr->nlba = nlba;
+    hdr->gen_offset = CRC32_TABLE_PAGE_SIZE;
+    hdr->table_offset = table_offset;
+    hdr->size = size;
+    hdr->magic = CRC32_TABLE_MAGIC;
+  }
+  assert(hdr->magic == CRC32_TABLE_MAGIC);
+  assert(hdr->size == size);
+
+  SPDK_INFOLOG(SPDK_LOG_NVME, "map crc32 table, %d-bit, %ld lba, size %ld\n",
+               hdr->width, hdr->nlba, hdr->size);
+  g_crc32_table_hdr = hdr;
+  g_crc32_width = hdr->width;
+  g_crc32_page_gen = (void*)hdr + hdr->gen_offset;
+  g_driver_csum_table_ptr = (void*)hdr + hdr->table_offset;
+  g_driver_table_size = hdr->nlba*(hdr->width/8);
+  return 0;
+}
+
+static void crc32_table_unmap(void)
+{
+  if (g_crc32_table_hdr != NULL)
+  {
+    munmap(g_crc32_table_hdr, g_crc32_table_hdr->size);
+    if (spdk_process_is_primary())
+    {
+      shm_unlink(g_crc32_table_name);
+    }
+  }
 
-static int memzone_reserve_shared_memory(uint64_t table_size)
+  g_crc32_table_hdr = NULL;
+  g_crc32_page_gen = NULL;
+  g_driver_csum_table_ptr = NULL;
+  g_driver_table_size = 0;
+}
+
+static int memzone_reserve_shared_memory(const char* traddr, uint32_t nsid,
+                                         uint64_t nlba, uint32_t crc_width)
 {
   if (spdk_process_is_primary())
   {
@@ -73,1012 +258,2960 @@ static int memzone_reserve_shared_memory(uint64_t table_size)
     assert(g_ioworker_status_table == NULL);
 
     // get the shared memory for token
-    SPDK_INFOLOG(SPDK_LOG_NVME, "create token table, size: %ld\n", table_size);
-    g_driver_table_size = table_size;
-    g_driver_csum_table_ptr = spdk_memzone_reserve(DRIVER_CRC32_TABLE_NAME,
-                                                   table_size,
-                                                   0, SPDK_MEMZONE_NO_IOVA_CONTIG);
+    SPDK_INFOLOG(SPDK_LOG_NVME, "create token table, lba count: %ld\n", nlba);
     g_driver_io_token_ptr = spdk_memzone_reserve(DRIVER_IO_TOKEN_NAME,
                                                  sizeof(uint64_t),
                                                  0, 0);
     g_ioworker_status_table = spdk_memzone_reserve(IOWORKER_STATUS_TABLE,
-                                                   sizeof(struct ioworker_status)*IOWORKER_STATUS_SLOTS,
+                                                   sizeof(struct ioworker_status_slot)*IOWORKER_STATUS_SLOTS,
                                                    0, 0);
   }
   else
   {
     // find the shared memory for token
-    g_driver_table_size = table_size;
     g_driver_io_token_ptr = spdk_memzone_lookup(DRIVER_IO_TOKEN_NAME);
-    g_driver_csum_table_ptr = spdk_memzone_lookup(DRIVER_CRC32_TABLE_NAME);
     g_ioworker_status_table = spdk_memzone_lookup(IOWORKER_STATUS_TABLE);
   }
-  
+
   if (g_driver_io_token_ptr == NULL ||
-      g_driver_csum_table_ptr == NULL||
       g_ioworker_status_table == NULL)
   {
     SPDK_ERRLOG("fail to find memzone space\n");
     return -1;
   }
 
+  if (0 != crc32_table_map(traddr, nsid, nlba, crc_width))
+  {
+    return -1;
+  }
+
   SPDK_DEBUGLOG(SPDK_LOG_NVME, "ioworker status %p\n", g_ioworker_status_table);
   return 0;
 }
 
-void crc32_clear(uint64_t lba, uint64_t lba_count, int sanitize, int uncorr)
+static inline uint32_t crc32_table_get(uint64_t lba)
 {
-  int c = uncorr ? 0xff : 0;
-  size_t len = lba_count*sizeof(uint32_t);
-  
-  if (sanitize == true)
+  switch (g_crc32_width)
   {
-    assert(lba == 0);
-    assert(g_driver_table_size != 0); //Namspace instance not exist, you may need to add nvme0n1 in the fixture list
-    SPDK_DEBUGLOG(SPDK_LOG_NVME, "clear the whole table\n");
-    len = g_driver_table_size;
+    case 8:
+      return ((uint8_t*)g_driver_csum_table_ptr)[lba];
+    case 16:
+      return ((uint16_t*)g_driver_csum_table_ptr)[lba];
+    default:
+      return ((uint32_t*)g_driver_csum_table_ptr)[lba];
   }
-
-  SPDK_DEBUGLOG(SPDK_LOG_NVME, "clear checksum table, lba 0x%lx, c %d, len %ld\n",
-               lba, c, len);
-  assert(g_driver_csum_table_ptr != NULL);
-  memset(&g_driver_csum_table_ptr[lba], c, len);
 }
 
-static void crc32_fini(void)
+static inline void crc32_table_set(uint64_t lba, uint32_t crc)
 {
-  if (spdk_process_is_primary())
+  switch (g_crc32_width)
   {
-    spdk_memzone_free(DRIVER_IO_TOKEN_NAME);
-    spdk_memzone_free(DRIVER_CRC32_TABLE_NAME);
+    case 8:
+      ((uint8_t*)g_driver_csum_table_ptr)[lba] = crc;
+      break;
+    case 16:
+      ((uint16_t*)g_driver_csum_table_ptr)[lba] = crc;
+      break;
+    default:
+      ((uint32_t*)g_driver_csum_table_ptr)[lba] = crc;
+      break;
   }
-  g_driver_io_token_ptr = NULL;
-  g_driver_csum_table_ptr = NULL;
 }
 
-
-////module: buffer
-///////////////////////////////
-
-void* buffer_init(size_t bytes, uint64_t *phys_addr)
+static inline uint64_t crc32_table_page(uint64_t lba)
 {
-  void* buf = spdk_dma_zmalloc(bytes, 0x1000, phys_addr);
+  return lba*(g_crc32_width/8)/CRC32_TABLE_PAGE_SIZE;
+}
 
-  SPDK_DEBUGLOG(SPDK_LOG_NVME, "buffer: alloc ptr at %p, size %ld\n",
-               buf, bytes);
+static inline uint32_t crc32_table_generation(void)
+{
+  return __atomic_load_n(&g_crc32_table_hdr->generation, __ATOMIC_ACQUIRE);
+}
 
-  assert(buf != NULL);
-  return buf;
+static inline bool crc32_page_is_populated(uint64_t page)
+{
+  return __atomic_load_n(&g_crc32_page_gen[page], __ATOMIC_ACQUIRE) ==
+      crc32_table_generation();
 }
 
-static inline uint32_t buffer_calc_csum(uint64_t* ptr, int len)
+static void crc32_page_activate(uint64_t page, uint32_t gen)
 {
-  uint32_t crc = spdk_crc32c_update(ptr, len, 0);
+  uint32_t page_gen = __atomic_load_n(&g_crc32_page_gen[page], __ATOMIC_ACQUIRE);
 
-  //reserve 0: nomapping
-  //reserve 0xffffffff: uncorrectable
-  if (crc == 0) crc = 1;
-  if (crc == 0xffffffff) crc = 0xfffffffe;
-  
-  return crc;
+  // stale page keeps the data of older generation, clear it before use.
+  // The page may be shared with other ioworker processes, so only one
+  // of them clears it, others wait it done.
+  while (page_gen != gen)
+  {
+    if (page_gen != CRC32_PAGE_GEN_BUSY &&
+        __atomic_compare_exchange_n(&g_crc32_page_gen[page], &page_gen,
+                                    CRC32_PAGE_GEN_BUSY, false,
+                                    __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+    {
+      memset(g_driver_csum_table_ptr + page*CRC32_TABLE_PAGE_SIZE,
+             0, CRC32_TABLE_PAGE_SIZE);
+      __atomic_store_n(&g_crc32_page_gen[page], gen, __ATOMIC_RELEASE);
+      break;
+    }
+
+    page_gen = __atomic_load_n(&g_crc32_page_gen[page], __ATOMIC_ACQUIRE);
+  }
 }
 
-static void buffer_fill_data(void* buf,
-                             uint64_t lba,
-                             uint32_t lba_count,
-                             uint32_t lba_size)
+static inline void crc32_page_populate(uint64_t page)
 {
-  // token is keeping increasing, so every write has different data
-  uint64_t token = __atomic_fetch_add(g_driver_io_token_ptr,
-                                      lba_count,
-                                      __ATOMIC_SEQ_CST);
-  
-  SPDK_DEBUGLOG(SPDK_LOG_NVME, "token: %ld\n", token);
-  SPDK_DEBUGLOG(SPDK_LOG_NVME, "lba count: %d\n", lba_count);
+  uint32_t gen = crc32_table_generation();
 
-  for (uint32_t i=0; i<lba_count; i++, lba++)
+  // avoid bouncing the tag cacheline when the page is already current
+  if (__atomic_load_n(&g_crc32_page_gen[page], __ATOMIC_ACQUIRE) != gen)
   {
-    uint64_t* ptr = (uint64_t*)(buf+i*lba_size);
+    crc32_page_activate(page, gen);
+  }
+}
 
-    //first and last 64bit-words are filled with special data
-    ptr[0] = lba;
-    ptr[lba_size/sizeof(uint64_t)-1] = token+i;
+static void crc32_table_invalidate(void)
+{
+  uint32_t gen = crc32_table_generation()+1;
 
-    //keep crc in memory
-    // suppose device modify data correctly. If the command fail, we cannot
-    // tell what part of data is updated, while what not. Even when atomic
-    // write is supported, we still cannot tell that. 
-    g_driver_csum_table_ptr[lba] = buffer_calc_csum(ptr, lba_size);
+  if (gen == CRC32_PAGE_GEN_BUSY)
+  {
+    // generation wraps, all tags have to be reset once
+    memset(g_crc32_page_gen, 0,
+           g_crc32_table_hdr->table_offset-g_crc32_table_hdr->gen_offset);
+    gen = 1;
   }
+
+  SPDK_DEBUGLOG(SPDK_LOG_NVME, "crc32 table generation %d\n", gen);
+  __atomic_store_n(&g_crc32_table_hdr->generation, gen, __ATOMIC_RELEASE);
 }
 
-static int buffer_verify_data(void* buf,
-                              unsigned long lba,
-                              uint32_t lba_count,
-                              uint32_t lba_size)
+static void crc32_page_release(uint64_t page, uint64_t pages)
 {
-  for (uint32_t i=0; i<lba_count; i++, lba++)
+  // hold the pages busy while punching them, so no ioworker activates
+  // one of them and writes a checksum which the punch would zero out
+  for (uint64_t i=page; i<page+pages; i++)
   {
-    uint32_t expected_crc = g_driver_csum_table_ptr[lba];
-    if (expected_crc == 0)
-    {
-      //no mapping, nothing to verify
-      continue;
-    }
-    
-    if (expected_crc == 0xffffffff)
-    {
-      SPDK_WARNLOG("lba uncorrectable: lba 0x%lx\n", lba);
-      return -1;
-    }
-    
-    unsigned long* ptr = (unsigned long*)(buf+i*lba_size);
-    if (lba != ptr[0])
-    {
-      SPDK_WARNLOG("lba mismatch: lba 0x%lx, but got: 0x%lx\n", lba, ptr[0]);
-      return -2;
-    }
+    uint32_t page_gen = __atomic_load_n(&g_crc32_page_gen[i], __ATOMIC_ACQUIRE);
 
-    uint32_t computed_crc = buffer_calc_csum(ptr, lba_size);
-    if (computed_crc != expected_crc)
+    while (page_gen == CRC32_PAGE_GEN_BUSY ||
+           !__atomic_compare_exchange_n(&g_crc32_page_gen[i], &page_gen,
+                                        CRC32_PAGE_GEN_BUSY, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
     {
-      SPDK_WARNLOG("crc mismatch: lba 0x%lx, expected crc 0x%x, but got: 0x%x\n",
-                   lba, expected_crc, computed_crc);
-      return -3;
+      page_gen = __atomic_load_n(&g_crc32_page_gen[i], __ATOMIC_ACQUIRE);
     }
   }
 
-  return 0;
+  if (0 != madvise(g_driver_csum_table_ptr + page*CRC32_TABLE_PAGE_SIZE,
+                   pages*CRC32_TABLE_PAGE_SIZE, MADV_REMOVE))
+  {
+    SPDK_DEBUGLOG(SPDK_LOG_NVME, "fail to release crc32 table pages: %s\n",
+                  strerror(errno));
+  }
+
+  for (uint64_t i=page; i<page+pages; i++)
+  {
+    __atomic_store_n(&g_crc32_page_gen[i], CRC32_PAGE_GEN_STALE, __ATOMIC_RELEASE);
+  }
 }
 
-void buffer_fini(void* buf)
+void crc32_clear(uint64_t lba, uint64_t lba_count, int sanitize, int uncorr)
 {
-  SPDK_DEBUGLOG(SPDK_LOG_NVME, "buffer: free ptr at %p\n", buf);
-  assert(buf != NULL);
-  spdk_dma_free(buf);
-}
+  int c = uncorr ? 0xff : 0;
+  uint32_t entry_size = g_crc32_width/8;
+  uint64_t entries_per_page = CRC32_TABLE_PAGE_SIZE/entry_size;
 
+  if (sanitize == true)
+  {
+    assert(lba == 0);
+    assert(g_driver_table_size != 0); //Namspace instance not exist, you may need to add nvme0n1 in the fixture list
+    SPDK_DEBUGLOG(SPDK_LOG_NVME, "clear the whole table\n");
+    lba_count = g_crc32_table_hdr->nlba;
+  }
 
-////cmd log
-///////////////////////////////
+  SPDK_DEBUGLOG(SPDK_LOG_NVME, "clear checksum table, lba 0x%lx, c %d, count %ld\n",
+               lba, c, lba_count);
+  assert(g_driver_csum_table_ptr != NULL);
+  assert(lba+lba_count <= g_crc32_table_hdr->nlba);
 
-// log_table contains latest cmd and cpl and their timestamps
-// queue_table traces cmd log tables by queue pairs
-// CMD_LOG_DEPTH should be larger than Q depth to keep all outstanding commands.
-#define CMD_LOG_DEPTH (2048)
-#define CMD_LOG_MAX_Q (32)
+  if (c == 0 && lba == 0 && lba_count == g_crc32_table_hdr->nlba)
+  {
+    // format, sanitize or whole drive trim: constant time
+    crc32_table_invalidate();
+    return;
+  }
 
-struct cmd_log_entry_t {
-  // cmd and cpl
-  struct timeval time_cmd;
-  struct spdk_nvme_cmd cmd;
-  struct timeval time_cpl;
-  struct spdk_nvme_cpl cpl;
+  // clear the table page by page
+  while (lba_count != 0)
+  {
+    uint64_t page = crc32_table_page(lba);
+    uint64_t count = MIN(lba_count, entries_per_page-lba%entries_per_page);
 
-  // for data verification after read
-  void* buf;
-  uint64_t lba;
-  uint16_t lba_count;
-  uint32_t lba_size;
-  
-  // callback to user functions
-  spdk_nvme_cmd_cb cb_fn;
-  void* cb_arg;
+    if (c == 0 && count == entries_per_page)
+    {
+      // the whole pages are cleared, release them and mark them stale
+      uint64_t pages = lba_count/entries_per_page;
 
-  uint64_t dummy[5];
-};
-static_assert(sizeof(struct cmd_log_entry_t)%64 == 0, "cacheline aligned");
+      crc32_page_release(page, pages);
+      count = pages*entries_per_page;
+    }
+    else if (c != 0 || crc32_page_is_populated(page))
+    {
+      // no need to clear a page not populated
+      crc32_page_populate(page);
+      memset(g_driver_csum_table_ptr + lba*entry_size, c, count*entry_size);
+    }
 
-struct cmd_log_table_t {
-  struct cmd_log_entry_t table[CMD_LOG_DEPTH];
-  uint32_t tail_index;
-};
+    lba += count;
+    lba_count -= count;
+  }
+}
 
-static struct cmd_log_table_t* cmd_log_queue_table[CMD_LOG_MAX_Q];
+static int crc32_file_map(const char* path, bool create,
+                          struct crc32_table_hdr** file)
+{
+  int fd;
+  struct stat st;
+  size_t size = g_crc32_table_hdr->size;
 
+  fd = open(path, create ? O_CREAT|O_TRUNC|O_RDWR : O_RDONLY, 0644);
+  if (fd < 0)
+  {
+    SPDK_ERRLOG("fail to open crc32 file %s: %s\n", path, strerror(errno));
+    return -1;
+  }
 
-#define US_PER_S   (1000ULL*1000ULL)
-#define MIN(X,Y)   ((X) < (Y) ? (X) : (Y))
+  // the file is sparse as the table, only populated pages are stored
+  if ((create && ftruncate(fd, size) != 0) ||
+      (!create && (fstat(fd, &st) != 0 || st.st_size != size)))
+  {
+    SPDK_ERRLOG("crc32 file %s size mismatch\n", path);
+    close(fd);
+    return -1;
+  }
 
+  *file = mmap(NULL, size, create ? PROT_READ|PROT_WRITE : PROT_READ,
+               MAP_SHARED, fd, 0);
+  close(fd);
+  if (*file == MAP_FAILED)
+  {
+    SPDK_ERRLOG("fail to map crc32 file %s: %s\n", path, strerror(errno));
+    return -1;
+  }
 
-static unsigned int timeval_to_us(struct timeval* t)
-{
-  return t->tv_sec*US_PER_S + t->tv_usec;
+  return 0;
 }
 
-static void cmd_log_init(void)
+int crc32_save(const char* path, const char* serial,
+               uint32_t nsid, uint32_t lbaf)
 {
-  for (int i=0; i<CMD_LOG_MAX_Q; i++)
+  uint32_t gen;
+  uint64_t pages;
+  struct crc32_table_hdr* file;
+
+  assert(g_crc32_table_hdr != NULL);
+  if (0 != crc32_file_map(path, true, &file))
   {
-    cmd_log_queue_table[i] = NULL;
+    return -1;
   }
+
+  gen = crc32_table_generation();
+  pages = (g_crc32_table_hdr->size-g_crc32_table_hdr->table_offset)/CRC32_TABLE_PAGE_SIZE;
+
+  // copy populated pages chunk by chunk, and write back each chunk
+  // before the next one, so the page cache does not hold the whole table
+  for (uint64_t first=0; first<pages; first+=CRC32_FILE_SYNC_PAGES)
+  {
+    uint64_t count = MIN(pages-first, CRC32_FILE_SYNC_PAGES);
+    uint32_t* file_gen = (void*)file + g_crc32_table_hdr->gen_offset;
+    void* file_table = (void*)file + g_crc32_table_hdr->table_offset;
+    bool dirty = false;
+
+    for (uint64_t page=first; page<first+count; page++)
+    {
+      if (g_crc32_page_gen[page] == gen)
+      {
+        memcpy(file_table + page*CRC32_TABLE_PAGE_SIZE,
+               g_driver_csum_table_ptr + page*CRC32_TABLE_PAGE_SIZE,
+               CRC32_TABLE_PAGE_SIZE);
+        file_gen[page] = 1;
+        dirty = true;
+      }
+    }
+
+    if (dirty)
+    {
+      void* addr = file_table + first*CRC32_TABLE_PAGE_SIZE;
+      size_t len = count*CRC32_TABLE_PAGE_SIZE;
+
+      msync(addr, len, MS_SYNC);
+      madvise(addr, len, MADV_DONTNEED);
+    }
+  }
+
+  // header is the last one to write, a partial file is never valid
+  msync((void*)file + g_crc32_table_hdr->gen_offset,
+        g_crc32_table_hdr->table_offset-g_crc32_table_hdr->gen_offset,
+        MS_SYNC);
+  memcpy(file, g_crc32_table_hdr, sizeof(struct crc32_table_hdr));
+  file->generation = 1;
+  file->token = *g_driver_io_token_ptr;
+  strncpy(file->serial, serial, sizeof(file->serial));
+  file->nsid = nsid;
+  file->lbaf = lbaf;
+  msync(file, CRC32_TABLE_PAGE_SIZE, MS_SYNC);
+
+  SPDK_INFOLOG(SPDK_LOG_NVME, "crc32 table saved to %s\n", path);
+  munmap(file, g_crc32_table_hdr->size);
+  return 0;
 }
 
-static int cmd_log_table_create(uint16_t qid)
+int crc32_load(const char* path, const char* serial,
+               uint32_t nsid, uint32_t lbaf)
 {
-  struct cmd_log_table_t* log_table;
+  uint32_t gen;
+  uint64_t pages;
+  struct crc32_table_hdr* file;
 
-  if (qid >= CMD_LOG_MAX_Q)
+  assert(g_crc32_table_hdr != NULL);
+  if (0 != crc32_file_map(path, false, &file))
   {
-    SPDK_ERRLOG("not support so many queue pairs\n");
     return -1;
   }
 
-  // get 64B aligned memory
-  log_table = aligned_alloc(64, sizeof(struct cmd_log_table_t));
-  if (log_table == NULL)
+  if (file->magic != CRC32_TABLE_MAGIC ||
+      file->width != g_crc32_table_hdr->width ||
+      file->nlba != g_crc32_table_hdr->nlba ||
+      file->nsid != nsid ||
+      file->lbaf != lbaf ||
+      strncmp(file->serial, serial, sizeof(file->serial)) != 0)
   {
-    SPDK_ERRLOG("memory allocate for cmd log fail\n");
-    return -1;
+    SPDK_ERRLOG("crc32 file %s does not match the namespace\n", path);
+    munmap(file, g_crc32_table_hdr->size);
+    return -2;
   }
 
-  SPDK_DEBUGLOG(SPDK_LOG_NVME, "address log table %p\n", log_table);
-  memset(log_table, 0, sizeof(struct cmd_log_table_t));
-  cmd_log_queue_table[qid] = log_table;
-  return 0;
-}
+  // drop the current table, and then copy populated pages from the file
+  crc32_table_invalidate();
+  gen = crc32_table_generation();
+  pages = (file->size-file->table_offset)/CRC32_TABLE_PAGE_SIZE;
+  for (uint64_t first=0; first<pages; first+=CRC32_FILE_SYNC_PAGES)
+  {
+    uint64_t count = MIN(pages-first, CRC32_FILE_SYNC_PAGES);
+    uint32_t* file_gen = (void*)file + file->gen_offset;
+    void* file_table = (void*)file + file->table_offset;
 
-static void cmd_log_table_delete(uint16_t qid)
-{
-  struct cmd_log_table_t* log_table = cmd_log_queue_table[qid];
+    for (uint64_t page=first; page<first+count; page++)
+    {
+      if (file_gen[page] == file->generation)
+      {
+        memcpy(g_driver_csum_table_ptr + page*CRC32_TABLE_PAGE_SIZE,
+               file_table + page*CRC32_TABLE_PAGE_SIZE,
+               CRC32_TABLE_PAGE_SIZE);
+        __atomic_store_n(&g_crc32_page_gen[page], gen, __ATOMIC_RELEASE);
+      }
+    }
 
-  assert(qid < CMD_LOG_MAX_Q);
+    madvise(file_table + first*CRC32_TABLE_PAGE_SIZE,
+            count*CRC32_TABLE_PAGE_SIZE, MADV_DONTNEED);
+  }
 
-  if (log_table != NULL)
+  // new data written after reload should differ from the saved data
+  if (*g_driver_io_token_ptr < file->token)
   {
-    free(log_table);
+    *g_driver_io_token_ptr = file->token;
+    token_lease_drop();
   }
+
+  SPDK_INFOLOG(SPDK_LOG_NVME, "crc32 table loaded from %s\n", path);
+  munmap(file, g_crc32_table_hdr->size);
+  return 0;
 }
 
-static struct cmd_log_entry_t*
-cmd_log_add_cmd(uint16_t qid,
-                void* buf,
-                uint64_t lba,
-                uint16_t lba_count,
-                uint32_t lba_size,
-                const struct spdk_nvme_cmd* cmd,
-                spdk_nvme_cmd_cb cb_fn,
-                void *cb_arg)
+static void crc32_fini(void)
+{
+  if (spdk_process_is_primary())
+  {
+    spdk_memzone_free(DRIVER_IO_TOKEN_NAME);
+  }
+  g_driver_io_token_ptr = NULL;
+  token_lease_drop();
+  crc32_table_unmap();
+}
+
+
+////module: buffer
+///////////////////////////////
+
+// DMA buffers are recycled in size classes of power of 2, from 4KB to
+// 2MB, in free lists of each NUMA node in the process. Buffers are zeroed
+// when they are returned, so they are ready for the next allocation.
+// Larger buffers are allocated and freed directly. The hugepage heap is
+// shared with other processes, so the process caches 8MB at most.
+#define BUFFER_POOL_CLASS_SHIFT     (12)
+#define BUFFER_POOL_CLASS_COUNT     (10)
+#define BUFFER_POOL_SOCKETS         (8)
+#define BUFFER_POOL_CLASS_BYTES     (8ULL<<20)
+#define BUFFER_POOL_CACHE_BYTES     (8ULL<<20)
+
+struct buffer_pool_entry {
+  void* buf;
+  uint64_t phys_addr;
+};
 
+struct buffer_pool_class {
+  struct buffer_pool_entry* entries;
+  uint32_t count;
+  uint32_t cap;
+};
+
+static struct buffer_pool_class g_buffer_pool[BUFFER_POOL_SOCKETS][BUFFER_POOL_CLASS_COUNT];
+static buffer_pool_stats g_buffer_pool_stats;
+static pthread_mutex_t g_buffer_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static int buffer_pool_class(size_t bytes)
 {
-  struct cmd_log_table_t* log_table = cmd_log_queue_table[qid];
-  uint32_t tail_index = cmd_log_queue_table[qid]->tail_index;
-  struct cmd_log_entry_t* log_entry = &log_table->table[tail_index];
+  int cls = 0;
 
-  assert(qid < CMD_LOG_MAX_Q);
-  assert(log_table != NULL);
-  assert(tail_index < CMD_LOG_DEPTH);
+  while ((1ULL<<(cls+BUFFER_POOL_CLASS_SHIFT)) < bytes)
+  {
+    cls ++;
+  }
 
-  log_entry->buf = buf;
-  log_entry->lba = lba;
-  log_entry->lba_count = lba_count;
-  log_entry->lba_size = lba_size;
-  log_entry->cb_fn = cb_fn;
-  log_entry->cb_arg = cb_arg;
-  memcpy(&log_entry->cmd, cmd, sizeof(struct spdk_nvme_cmd));
-  gettimeofday(&log_entry->time_cmd, NULL);
-  tail_index += 1;
-  if (tail_index == CMD_LOG_DEPTH)
+  return cls < BUFFER_POOL_CLASS_COUNT ? cls : -1;
+}
+
+// free lists of any node are at index 0
+static inline struct buffer_pool_class* buffer_pool_get(int socket, int cls)
+{
+  int s = (socket >= 0 && socket < BUFFER_POOL_SOCKETS-1) ? socket+1 : 0;
+
+  return &g_buffer_pool[s][cls];
+}
+
+// allocate DMA buffer from the memory of the NUMA node, or any node
+static void* buffer_init_socket(size_t bytes, uint64_t *phys_addr, int socket)
+{
+  void* buf = NULL;
+  uint64_t phys = 0;
+  int cls = buffer_pool_class(bytes);
+
+  if (cls >= 0)
   {
-    tail_index = 0;
+    struct buffer_pool_class* pc = buffer_pool_get(socket, cls);
+
+    pthread_mutex_lock(&g_buffer_pool_lock);
+    if (pc->count != 0)
+    {
+      pc->count --;
+      buf = pc->entries[pc->count].buf;
+      phys = pc->entries[pc->count].phys_addr;
+      g_buffer_pool_stats.hit ++;
+      g_buffer_pool_stats.cached_bytes -= 1ULL<<(cls+BUFFER_POOL_CLASS_SHIFT);
+    }
+    else
+    {
+      g_buffer_pool_stats.miss ++;
+    }
+    pthread_mutex_unlock(&g_buffer_pool_lock);
+
+    // allocate the whole class, so it can be reused by any size in the class
+    bytes = 1ULL<<(cls+BUFFER_POOL_CLASS_SHIFT);
   }
-  cmd_log_queue_table[qid]->tail_index = tail_index;
 
-  return log_entry;
+  if (buf == NULL)
+  {
+    buf = spdk_dma_zmalloc_socket(bytes, 0x1000, &phys, socket);
+  }
+
+  SPDK_DEBUGLOG(SPDK_LOG_NVME, "buffer: alloc ptr at %p, size %ld, socket %d\n",
+               buf, bytes, socket);
+
+  assert(buf != NULL);
+  if (phys_addr != NULL)
+  {
+    *phys_addr = phys;
+  }
+  return buf;
 }
 
-static void cmd_log_add_cpl_cb(void* cb_ctx, const struct spdk_nvme_cpl* cpl)
+void* buffer_init(size_t bytes, uint64_t *phys_addr)
 {
-  struct timeval diff;
-  struct cmd_log_entry_t* log_entry = (struct cmd_log_entry_t*)cb_ctx;
+  return buffer_init_socket(bytes, phys_addr, SPDK_ENV_SOCKET_ID_ANY);
+}
 
-  assert(cpl != NULL);
-  assert(log_entry != NULL);
+static void buffer_fini_socket(void* buf, size_t bytes, uint64_t phys_addr, int socket)
+{
+  int cls = buffer_pool_class(bytes);
 
-  //reuse dword2 of cpl as latency value
-  gettimeofday(&log_entry->time_cpl, NULL);
-  memcpy(&log_entry->cpl, cpl, sizeof(struct spdk_nvme_cpl));
-  timersub(&log_entry->time_cpl, &log_entry->time_cmd, &diff);
-  (&log_entry->cpl.cdw0)[2] = timeval_to_us(&diff);
-  //SPDK_DEBUGLOG(SPDK_LOG_NVME, "cmd completed, cid %d\n", log_entry->cpl.cid);
+  SPDK_DEBUGLOG(SPDK_LOG_NVME, "buffer: free ptr at %p\n", buf);
+  assert(buf != NULL);
+
+  if (cls >= 0)
+  {
+    struct buffer_pool_class* pc = buffer_pool_get(socket, cls);
+    size_t class_bytes = 1ULL<<(cls+BUFFER_POOL_CLASS_SHIFT);
+
+    // zero it out of the lock, to be returned in next allocation
+    memset(buf, 0, class_bytes);
+
+    pthread_mutex_lock(&g_buffer_pool_lock);
+    if (pc->entries == NULL)
+    {
+      pc->cap = MAX(16, BUFFER_POOL_CLASS_BYTES/class_bytes);
+      pc->entries = malloc(sizeof(struct buffer_pool_entry)*pc->cap);
+      assert(pc->entries != NULL);
+    }
+
+    if (pc->count < pc->cap &&
+        g_buffer_pool_stats.cached_bytes+class_bytes <= BUFFER_POOL_CACHE_BYTES)
+    {
+      pc->entries[pc->count].buf = buf;
+      pc->entries[pc->count].phys_addr = phys_addr;
+      pc->count ++;
+      g_buffer_pool_stats.recycle ++;
+      g_buffer_pool_stats.cached_bytes += class_bytes;
+      buf = NULL;
+    }
+    pthread_mutex_unlock(&g_buffer_pool_lock);
+  }
+
+  if (buf != NULL)
+  {
+    // the free list or the cache is full, or the buffer is too large
+    pthread_mutex_lock(&g_buffer_pool_lock);
+    g_buffer_pool_stats.release ++;
+    pthread_mutex_unlock(&g_buffer_pool_lock);
+    spdk_dma_free(buf);
+  }
+}
+
+void buffer_pool_get_stats(buffer_pool_stats* stats)
+{
+  pthread_mutex_lock(&g_buffer_pool_lock);
+  *stats = g_buffer_pool_stats;
+  pthread_mutex_unlock(&g_buffer_pool_lock);
+}
+
+// release all cached buffers
+void buffer_pool_fini(void)
+{
+  pthread_mutex_lock(&g_buffer_pool_lock);
+  for (int s=0; s<BUFFER_POOL_SOCKETS; s++)
+  {
+    for (int cls=0; cls<BUFFER_POOL_CLASS_COUNT; cls++)
+    {
+      struct buffer_pool_class* pc = &g_buffer_pool[s][cls];
+
+      for (uint32_t i=0; i<pc->count; i++)
+      {
+        spdk_dma_free(pc->entries[i].buf);
+      }
+      free(pc->entries);
+      pc->entries = NULL;
+      pc->count = 0;
+      pc->cap = 0;
+    }
+  }
+  g_buffer_pool_stats.cached_bytes = 0;
+  pthread_mutex_unlock(&g_buffer_pool_lock);
+}
+
+// crc32c of sectors are independent with each other, so several sectors
+// are calculated in interleaved streams to hide the latency of the crc32
+// instruction. The kernel is selected by cpu features in driver_init().
+#define CSUM_INTERLEAVE   (4)
+#define CSUM_BATCH        (16)
+
+typedef void (*crc32c_sectors_func)(const void* buf,
+                                    uint32_t count,
+                                    uint32_t size,
+                                    uint32_t* crc);
+
+static void crc32c_sectors_serial(const void* buf,
+                                  uint32_t count,
+                                  uint32_t size,
+                                  uint32_t* crc)
+{
+  for (uint32_t i=0; i<count; i++)
+  {
+    crc[i] = spdk_crc32c_update(buf+i*size, size, 0);
+  }
+}
+
+#ifdef __x86_64__
+__attribute__((target("sse4.2")))
+static void crc32c_sectors_interleave(const void* buf,
+                                      uint32_t count,
+                                      uint32_t size,
+                                      uint32_t* crc)
+{
+  uint32_t i = 0;
+  uint32_t words = size/sizeof(uint64_t);
+
+  assert(size%sizeof(uint64_t) == 0);
+
+  for (; i+CSUM_INTERLEAVE <= count; i+=CSUM_INTERLEAVE)
+  {
+    const uint64_t* p0 = buf+i*size;
+    const uint64_t* p1 = p0+words;
+    const uint64_t* p2 = p1+words;
+    const uint64_t* p3 = p2+words;
+    uint64_t c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+
+    for (uint32_t j=0; j<words; j++)
+    {
+      c0 = _mm_crc32_u64(c0, p0[j]);
+      c1 = _mm_crc32_u64(c1, p1[j]);
+      c2 = _mm_crc32_u64(c2, p2[j]);
+      c3 = _mm_crc32_u64(c3, p3[j]);
+    }
+
+    crc[i] = c0;
+    crc[i+1] = c1;
+    crc[i+2] = c2;
+    crc[i+3] = c3;
+  }
+
+  // remaining sectors
+  for (; i<count; i++)
+  {
+    const uint64_t* p = buf+i*size;
+    uint64_t c = 0;
+
+    for (uint32_t j=0; j<words; j++)
+    {
+      c = _mm_crc32_u64(c, p[j]);
+    }
+    crc[i] = c;
+  }
+}
+#endif
+
+static crc32c_sectors_func g_crc32c_sectors = crc32c_sectors_serial;
+
+static void crc32c_sectors_init(void)
+{
+#ifdef __x86_64__
+  if (__builtin_cpu_supports("sse4.2"))
+  {
+    SPDK_DEBUGLOG(SPDK_LOG_NVME, "crc32c: %d-way interleaved sse4.2\n",
+                  CSUM_INTERLEAVE);
+    g_crc32c_sectors = crc32c_sectors_interleave;
+    return;
+  }
+#endif
+
+  g_crc32c_sectors = crc32c_sectors_serial;
+}
+
+static inline uint32_t buffer_calc_csum(uint32_t crc)
+{
+  uint32_t uncorr = 0xffffffff >> (32-g_crc32_width);
+
+  // fold crc32c to the digest width of the table
+  if (g_crc32_width < 32) crc ^= crc >> 16;
+  if (g_crc32_width < 16) crc ^= crc >> 8;
+  crc &= uncorr;
+
+  //reserve 0: nomapping
+  //reserve 0xffffffff: uncorrectable
+  if (crc == 0) crc = 1;
+  if (crc == uncorr) crc = uncorr-1;
+
+  return crc;
+}
+
+static void buffer_fill_data(void* buf,
+                             uint64_t lba,
+                             uint32_t lba_count,
+                             uint32_t lba_size)
+{
+  uint32_t crc[CSUM_BATCH];
+
+  // token is keeping increasing, so every write has different data
+  uint64_t token = token_alloc(lba_count);
   
-  //verify read data
-  if (log_entry->cmd.opc == 2 && log_entry->buf != NULL)
+  SPDK_DEBUGLOG(SPDK_LOG_NVME, "token: %ld\n", token);
+  SPDK_DEBUGLOG(SPDK_LOG_NVME, "lba count: %d\n", lba_count);
+
+  for (uint32_t i=0; i<lba_count; i++)
   {
-    int ret = 0;
+    uint64_t* ptr = (uint64_t*)(buf+i*lba_size);
+
+    //first and last 64bit-words are filled with special data
+    ptr[0] = lba+i;
+    ptr[lba_size/sizeof(uint64_t)-1] = token+i;
+  }
+
+  //keep crc in memory
+  // suppose device modify data correctly. If the command fail, we cannot
+  // tell what part of data is updated, while what not. Even when atomic
+  // write is supported, we still cannot tell that. 
+  for (uint32_t i=0; i<lba_count; i+=CSUM_BATCH)
+  {
+    uint32_t count = MIN(CSUM_BATCH, lba_count-i);
+
+    g_crc32c_sectors(buf+i*lba_size, count, lba_size, crc);
+    for (uint32_t j=0; j<count; j++)
+    {
+      crc32_page_populate(crc32_table_page(lba+i+j));
+      crc32_table_set(lba+i+j, buffer_calc_csum(crc[j]));
+    }
+  }
+}
+
+static int buffer_verify_data(void* buf,
+                              unsigned long lba,
+                              uint32_t lba_count,
+                              uint32_t lba_size)
+{
+  uint32_t uncorr = 0xffffffff >> (32-g_crc32_width);
+  uint32_t expected_crc[CSUM_BATCH];
+  uint32_t computed_crc[CSUM_BATCH];
+
+  for (uint32_t i=0; i<lba_count; i+=CSUM_BATCH)
+  {
+    uint32_t count = MIN(CSUM_BATCH, lba_count-i);
+    bool need_crc = false;
+
+    // find the expected crc of the batch
+    for (uint32_t j=0; j<count; j++)
+    {
+      expected_crc[j] = 0;
+      if (crc32_page_is_populated(crc32_table_page(lba+i+j)))
+      {
+        //never written, or cleared after written, is no mapping
+        expected_crc[j] = crc32_table_get(lba+i+j);
+      }
+
+      if (expected_crc[j] != 0 && expected_crc[j] != uncorr)
+      {
+        need_crc = true;
+      }
+    }
+
+    // only calculate crc when the batch has data to verify
+    if (need_crc)
+    {
+      g_crc32c_sectors(buf+i*lba_size, count, lba_size, computed_crc);
+    }
+
+    for (uint32_t j=0; j<count; j++)
+    {
+      unsigned long* ptr = (unsigned long*)(buf+(i+j)*lba_size);
+
+      if (expected_crc[j] == 0)
+      {
+        //no mapping, nothing to verify
+        continue;
+      }
     
-    assert (log_entry->lba_count != 0);
-    assert (log_entry->lba_size != 0);
-    assert (log_entry->lba_size == 512);
+      if (expected_crc[j] == uncorr)
+      {
+        SPDK_WARNLOG("lba uncorrectable: lba 0x%lx\n", lba+i+j);
+        return -1;
+      }
     
-    ret = buffer_verify_data(log_entry->buf,
-                             log_entry->lba,
-                             log_entry->lba_count,
-                             log_entry->lba_size);
-    if (ret != 0)
-    {
-      //Unrecovered Read Error: The read data could not be recovered from the media.
-      log_entry->cpl.status.sct = 0x02;
-      log_entry->cpl.status.sc = 0x81;
+      if (lba+i+j != ptr[0])
+      {
+        SPDK_WARNLOG("lba mismatch: lba 0x%lx, but got: 0x%lx\n", lba+i+j, ptr[0]);
+        return -2;
+      }
+
+      if (buffer_calc_csum(computed_crc[j]) != expected_crc[j])
+      {
+        SPDK_WARNLOG("crc mismatch: lba 0x%lx, expected crc 0x%x, but got: 0x%x\n",
+                     lba+i+j, expected_crc[j], buffer_calc_csum(computed_crc[j]));
+        return -3;
+      }
     }
   }
 
-  //callback to cython layer
-  if (log_entry->cb_fn)
+  return 0;
+}
+
+uint64_t crc32c_benchmark(void* buf, size_t len,
+                          unsigned int loops, int vectorized)
+{
+  uint64_t start;
+  uint64_t ticks;
+  uint32_t crc[CSUM_BATCH];
+  uint32_t sectors = len/512;
+  crc32c_sectors_func func = vectorized ? g_crc32c_sectors : crc32c_sectors_serial;
+  volatile uint32_t sink = 0;
+
+  // the same batches as in buffer_fill_data() and buffer_verify_data()
+  start = spdk_get_ticks();
+  for (unsigned int l=0; l<loops; l++)
   {
-    log_entry->cb_fn(log_entry->cb_arg, &log_entry->cpl);
+    for (uint32_t i=0; i<sectors; i+=CSUM_BATCH)
+    {
+      func(buf+i*512, MIN(CSUM_BATCH, sectors-i), 512, crc);
+      sink ^= crc[0];
+    }
   }
+  ticks = spdk_get_ticks() - start;
+
+  // return the time in nanoseconds
+  (void)sink;
+  return ticks*1000ULL/(spdk_get_ticks_hz()/US_PER_S);
+}
+
+void buffer_fini(void* buf, size_t bytes, uint64_t phys_addr)
+{
+  buffer_fini_socket(buf, bytes, phys_addr, SPDK_ENV_SOCKET_ID_ANY);
 }
 
 
-//// probe callbacks
-///////////////////////////////
+////cmd log
+///////////////////////////////
+
+// log_table contains latest cmd and cpl and their timestamps
+// queue_table traces cmd log tables by queue pairs
+// CMD_LOG_DEPTH should be larger than Q depth to keep all outstanding commands.
+#define CMD_LOG_DEPTH (2048)
+#define CMD_LOG_MAX_Q (32)
+
+struct cmd_log_entry_t {
+  // cmd and cpl, time in ticks
+  uint64_t time_cmd;
+  struct spdk_nvme_cmd cmd;
+  uint64_t time_cpl;
+  struct spdk_nvme_cpl cpl;
+
+  // for data verification after read
+  void* buf;
+  uint64_t lba;
+  uint16_t lba_count;
+  uint32_t lba_size;
+  
+  // callback to user functions
+  spdk_nvme_cmd_cb cb_fn;
+  void* cb_arg;
+
+  // admin completion counter of the submitting thread
+  uint32_t* cpl_count;
+
+  uint64_t dummy[6];
+};
+static_assert(sizeof(struct cmd_log_entry_t)%64 == 0, "cacheline aligned");
+
+struct cmd_log_table_t {
+  struct cmd_log_entry_t table[CMD_LOG_DEPTH];
+  uint32_t tail_index;
+};
+
+static struct cmd_log_table_t* cmd_log_queue_table[CMD_LOG_MAX_Q];
+
+// completions are collected in the batch during the poll of this thread
+static __thread struct cpl_batch* g_cpl_batch = NULL;
+
+// completions of the admin commands submitted by this thread, which may
+// be reaped by other threads polling the same admin queue. It is never
+// freed, so late completions after the thread exits are still safe.
+static __thread uint32_t* g_cmd_cpl_count = NULL;
+
+static uint32_t* cmd_log_cpl_count(void)
+{
+  if (g_cmd_cpl_count == NULL)
+  {
+    g_cmd_cpl_count = calloc(1, sizeof(uint32_t));
+    assert(g_cmd_cpl_count != NULL);
+  }
+
+  return g_cmd_cpl_count;
+}
+
+// take the completions of this thread's admin commands reaped so far
+static inline int cmd_log_cpl_count_take(void)
+{
+  return (int)__atomic_exchange_n(cmd_log_cpl_count(), 0, __ATOMIC_ACQ_REL);
+}
+
+
+// timestamps in hot path are ticks, which are converted to time only
+// when they are reported. The base pairs the ticks with the wall-clock.
+static uint64_t g_driver_ticks_hz = 0;
+static uint64_t g_driver_ticks_base = 0;
+static struct timeval g_driver_time_base;
+
+static void timestamp_init(void)
+{
+  g_driver_ticks_hz = spdk_get_ticks_hz();
+  g_driver_ticks_base = spdk_get_ticks();
+  gettimeofday(&g_driver_time_base, NULL);
+}
+
+static inline uint64_t ticks_to_ns(uint64_t ticks)
+{
+  return (ticks/g_driver_ticks_hz)*NS_PER_S +
+    (ticks%g_driver_ticks_hz)*NS_PER_S/g_driver_ticks_hz;
+}
+
+static inline uint64_t ns_to_ticks(uint64_t ns)
+{
+  return (ns/NS_PER_S)*g_driver_ticks_hz +
+    (ns%NS_PER_S)*g_driver_ticks_hz/NS_PER_S;
+}
+
+static void ticks_to_timeval(uint64_t ticks, struct timeval* tv)
+{
+  uint64_t us;
+  struct timeval diff;
+
+  if (ticks < g_driver_ticks_base)
+  {
+    // never stamped
+    timerclear(tv);
+    return;
+  }
+
+  us = ticks_to_ns(ticks-g_driver_ticks_base)/1000;
+  diff.tv_sec = us/US_PER_S;
+  diff.tv_usec = us%US_PER_S;
+  timeradd(&g_driver_time_base, &diff, tv);
+}
+
+static void cmd_log_init(void)
+{
+  for (int i=0; i<CMD_LOG_MAX_Q; i++)
+  {
+    cmd_log_queue_table[i] = NULL;
+  }
+}
+
+static int cmd_log_table_create(uint16_t qid)
+{
+  struct cmd_log_table_t* log_table;
+
+  if (qid >= CMD_LOG_MAX_Q)
+  {
+    SPDK_ERRLOG("not support so many queue pairs\n");
+    return -1;
+  }
+
+  // get 64B aligned memory
+  log_table = aligned_alloc(64, sizeof(struct cmd_log_table_t));
+  if (log_table == NULL)
+  {
+    SPDK_ERRLOG("memory allocate for cmd log fail\n");
+    return -1;
+  }
+
+  SPDK_DEBUGLOG(SPDK_LOG_NVME, "address log table %p\n", log_table);
+  memset(log_table, 0, sizeof(struct cmd_log_table_t));
+  cmd_log_queue_table[qid] = log_table;
+  return 0;
+}
+
+static void cmd_log_table_delete(uint16_t qid)
+{
+  struct cmd_log_table_t* log_table = cmd_log_queue_table[qid];
+
+  assert(qid < CMD_LOG_MAX_Q);
+
+  if (log_table != NULL)
+  {
+    free(log_table);
+  }
+}
+
+static struct cmd_log_entry_t*
+cmd_log_add_cmd(uint16_t qid,
+                void* buf,
+                uint64_t lba,
+                uint16_t lba_count,
+                uint32_t lba_size,
+                const struct spdk_nvme_cmd* cmd,
+                spdk_nvme_cmd_cb cb_fn,
+                void *cb_arg)
+
+{
+  struct cmd_log_table_t* log_table = cmd_log_queue_table[qid];
+  uint32_t tail_index = cmd_log_queue_table[qid]->tail_index;
+  struct cmd_log_entry_t* log_entry = &log_table->table[tail_index];
+
+  assert(qid < CMD_LOG_MAX_Q);
+  assert(log_table != NULL);
+  assert(tail_index < CMD_LOG_DEPTH);
+
+  log_entry->buf = buf;
+  log_entry->lba = lba;
+  log_entry->lba_count = lba_count;
+  log_entry->lba_size = lba_size;
+  log_entry->cb_fn = cb_fn;
+  log_entry->cb_arg = cb_arg;
+  log_entry->cpl_count = (qid == 0) ? cmd_log_cpl_count() : NULL;
+  memcpy(&log_entry->cmd, cmd, sizeof(struct spdk_nvme_cmd));
+  log_entry->time_cmd = spdk_get_ticks();
+  tail_index += 1;
+  if (tail_index == CMD_LOG_DEPTH)
+  {
+    tail_index = 0;
+  }
+  cmd_log_queue_table[qid]->tail_index = tail_index;
+
+  return log_entry;
+}
+
+static void cmd_log_add_cpl_cb(void* cb_ctx, const struct spdk_nvme_cpl* cpl)
+{
+  struct cmd_log_entry_t* log_entry = (struct cmd_log_entry_t*)cb_ctx;
+  uint32_t* cpl_count = log_entry->cpl_count;
+
+  assert(cpl != NULL);
+  assert(log_entry != NULL);
+
+  //reuse dword2 of cpl as latency value, in us
+  log_entry->time_cpl = spdk_get_ticks();
+  memcpy(&log_entry->cpl, cpl, sizeof(struct spdk_nvme_cpl));
+  (&log_entry->cpl.cdw0)[2] = ticks_to_ns(log_entry->time_cpl-log_entry->time_cmd)/1000;
+  //SPDK_DEBUGLOG(SPDK_LOG_NVME, "cmd completed, cid %d\n", log_entry->cpl.cid);
+  
+  //verify read data
+  if (log_entry->cmd.opc == 2 && log_entry->buf != NULL)
+  {
+    int ret = 0;
+    
+    assert (log_entry->lba_count != 0);
+    assert (log_entry->lba_size != 0);
+    assert (log_entry->lba_size == 512);
+    
+    ret = buffer_verify_data(log_entry->buf,
+                             log_entry->lba,
+                             log_entry->lba_count,
+                             log_entry->lba_size);
+    if (ret != 0)
+    {
+      //Unrecovered Read Error: The read data could not be recovered from the media.
+      log_entry->cpl.status.sct = 0x02;
+      log_entry->cpl.status.sc = 0x81;
+    }
+  }
+
+  //callback to cython layer
+  if (log_entry->cb_fn)
+  {
+    struct cpl_batch* batch = g_cpl_batch;
+
+    //collect the completion of this thread's command, and the batch is
+    //handled after the poll
+    if (batch != NULL &&
+        batch->cb_fn == log_entry->cb_fn &&
+        (cpl_count == NULL || cpl_count == g_cmd_cpl_count) &&
+        batch->count < batch->size)
+    {
+      struct cpl_batch_entry* e = &batch->entries[batch->count++];
+
+      e->cid = log_entry->cpl.cid;
+      e->status = *(uint16_t*)&log_entry->cpl.status;
+      e->cdw0 = log_entry->cpl.cdw0;
+      e->latency = (&log_entry->cpl.cdw0)[2];
+    }
+    else
+    {
+      log_entry->cb_fn(log_entry->cb_arg, &log_entry->cpl);
+    }
+  }
+
+  //count admin command for the submitting thread after its callback
+  if (cpl_count != NULL)
+  {
+    __atomic_fetch_add(cpl_count, 1, __ATOMIC_RELEASE);
+  }
+}
+
+
+//// probe callbacks
+///////////////////////////////
+
+struct cb_ctx {
+  struct spdk_nvme_transport_id* trid;
+  struct spdk_nvme_ctrlr* ctrlr;
+};
+
+static bool probe_cb(void *cb_ctx,
+                     const struct spdk_nvme_transport_id *trid,
+                     struct spdk_nvme_ctrlr_opts *opts)
+{
+  struct spdk_nvme_transport_id* target = ((struct cb_ctx*)cb_ctx)->trid;
+
+  if (0 == spdk_nvme_transport_id_compare(target, trid))
+  {
+    SPDK_DEBUGLOG(SPDK_LOG_NVME, "Attaching to %s\n", trid->traddr);
+    return true;
+  }
+
+  return false;
+}
+
+
+static void attach_cb(void *cb_ctx,
+                      const struct spdk_nvme_transport_id *trid,
+                      struct spdk_nvme_ctrlr *ctrlr,
+                      const struct spdk_nvme_ctrlr_opts *opts)
+{
+	const struct spdk_nvme_ctrlr_data *cdata = spdk_nvme_ctrlr_get_data(ctrlr);
+
+  SPDK_INFOLOG(SPDK_LOG_NVME,
+               "attached device %s: %s, %d namespaces, pid %d\n",
+               trid->traddr, cdata->mn,
+               spdk_nvme_ctrlr_get_num_ns(ctrlr),
+               getpid());
+
+  ((struct cb_ctx*)cb_ctx)->ctrlr = ctrlr;
+}
+
+
+////driver system
+///////////////////////////////
+
+static_assert(DEBUG, "must enable DEBUG for more assert and check");
+
+// hex core mask of the single core, for any count of cores
+static void driver_core_mask(char* buf, unsigned int core)
+{
+  buf += sprintf(buf, "0x%x", 1<<(core%4));
+  for (unsigned int i=0; i<core/4; i++)
+  {
+    *buf++ = '0';
+  }
+  *buf = '\0';
+}
+
+int driver_init(int core)
+{
+  int ret = 0;
+  char buf[80];
+  struct spdk_env_opts opts;
+
+  //init random sequence reproducible
+  srandom(1);
+
+  //select crc32c kernel by cpu features
+  crc32c_sectors_init();
+  
+  // init cmd log and create one for admin queue
+  cmd_log_init();
+  ret = cmd_log_table_create(0);
+  if (ret != 0)
+  {
+    return ret;
+  }
+
+  // run on the given core, or distribute multiprocessing to different cores
+  if (core < 0)
+  {
+    core = getpid()%get_nprocs();
+  }
+  assert(core < 4*(sizeof(buf)-4));
+  spdk_env_opts_init(&opts);
+  driver_core_mask(buf, core);
+  opts.core_mask = buf;
+  opts.shm_id = 0;
+  opts.name = "pynvme_driver";
+  opts.mem_size = 5892;
+  if (spdk_env_init(&opts) < 0)
+  {
+    fprintf(stderr, "Unable to initialize SPDK env\n");
+    return -1;
+  }
+
+  // ticks are available after env init
+  timestamp_init();
+
+  // log level setup
+  spdk_log_set_flag("nvme");
+  spdk_log_set_print_level(SPDK_LOG_INFO);
+
+  return 0;
+}
+
+int driver_fini(void)
+{
+  //release DMA buffers cached in the pool
+  buffer_pool_fini();
+
+  //delete cmd log of admin queue
+  cmd_log_table_delete(0);
+  SPDK_DEBUGLOG(SPDK_LOG_NVME, "pynvme driver unloaded.\n");
+	return 0;
+}
+
+
+////module: pcie ctrlr
+///////////////////////////////
+
+struct spdk_pci_device* pcie_init(struct spdk_nvme_ctrlr* ctrlr)
+{
+  return spdk_nvme_ctrlr_get_pci_device(ctrlr);
+}
+
+int pcie_cfg_read8(struct spdk_pci_device* pci,
+                   unsigned char* value,
+                   unsigned int offset)
+{
+  return spdk_pci_device_cfg_read8(pci, value, offset);
+}
+
+int pcie_cfg_write8(struct spdk_pci_device* pci,
+                    unsigned char value,
+                    unsigned int offset)
+{
+  return spdk_pci_device_cfg_write8(pci, value, offset);
+}
+
+
+////module: nvme ctrlr
+///////////////////////////////
+struct spdk_nvme_ctrlr* nvme_probe(char * traddr)
+{
+  struct spdk_nvme_transport_id trid;
+  struct cb_ctx cb_ctx;
+	int rc;
+
+  SPDK_DEBUGLOG(SPDK_LOG_NVME, "looking for NVMe @%s\n", traddr);
+
+  // device address
+  if (strchr(traddr, ':') != NULL)
+  {
+    // pcie address: contains ':' characters
+    trid.trtype = SPDK_NVME_TRANSPORT_PCIE;
+    strncpy(trid.traddr, traddr, strlen(traddr)+1);
+  }
+  else
+  {
+    // tcp/ip address: fixed port to 4420
+    trid.trtype = SPDK_NVME_TRANSPORT_TCP;
+    trid.adrfam = SPDK_NVMF_ADRFAM_IPV4;
+    strncpy(trid.traddr, traddr, strlen(traddr)+1);
+    strncpy(trid.trsvcid, "4420", 4+1);
+  }
+
+  cb_ctx.trid = &trid;
+  cb_ctx.ctrlr = NULL;
+  rc = spdk_nvme_probe(&trid, &cb_ctx, probe_cb, attach_cb, NULL);
+  if (rc != 0 || cb_ctx.ctrlr == NULL)
+  {
+    SPDK_ERRLOG("not found device: %s, rc %d, cb_ctx.ctrlr %p\n",
+                trid.traddr, rc, cb_ctx.ctrlr);
+    return NULL;
+  }
+
+  return cb_ctx.ctrlr;
+}
+
+struct spdk_nvme_ctrlr* nvme_init(char * traddr)
+{
+  struct spdk_nvme_ctrlr* ctrlr;
+
+  //enum the device
+  ctrlr = nvme_probe(traddr);
+  if (ctrlr == NULL)
+  {
+    return NULL;
+  }
+
+  SPDK_DEBUGLOG(SPDK_LOG_NVME, "found device: %s\n", ctrlr->trid.traddr);
+  return ctrlr;
+}
+
+int nvme_fini(struct spdk_nvme_ctrlr* ctrlr)
+{
+  SPDK_DEBUGLOG(SPDK_LOG_NVME, "free ctrlr: %s\n", ctrlr->trid.traddr);
+
+  if (ctrlr == NULL)
+  {
+    return 0;
+  }
+
+  // io qpairs should all be deleted before closing master controller 
+  if (true == spdk_process_is_primary() &&
+      false == TAILQ_EMPTY(&ctrlr->active_io_qpairs))
+  {
+    return -1;
+  }
+  
+  SPDK_DEBUGLOG(SPDK_LOG_NVME, "close device: %s\n", ctrlr->trid.traddr);
+  return spdk_nvme_detach(ctrlr);
+}
+
+int nvme_set_reg32(struct spdk_nvme_ctrlr* ctrlr,
+                   unsigned int offset,
+                   unsigned int value)
+{
+  return nvme_pcie_ctrlr_set_reg_4(ctrlr, offset, value);
+}
+
+int nvme_get_reg32(struct spdk_nvme_ctrlr* ctrlr,
+                   unsigned int offset,
+                   unsigned int* value)
+{
+  return nvme_pcie_ctrlr_get_reg_4(ctrlr, offset, value);
+}
+
+int nvme_wait_completion_admin(struct spdk_nvme_ctrlr* ctrlr)
+{
+  return spdk_nvme_ctrlr_process_admin_completions(ctrlr);
+}
+
+// poll till expected completions are reaped, or usec elapsed
+int nvme_wait_completion_admin_timed(struct spdk_nvme_ctrlr* ctrlr,
+                                     uint32_t expected,
+                                     uint32_t usec)
+{
+  int reaped = 0;
+  uint64_t end = spdk_get_ticks() + ns_to_ticks(usec*1000ULL);
+
+  // other threads may reap completions of this thread's commands
+  do
+  {
+    spdk_nvme_ctrlr_process_admin_completions(ctrlr);
+    reaped += cmd_log_cpl_count_take();
+  } while (reaped < (int)expected && spdk_get_ticks() < end);
+
+  return reaped;
+}
+
+// admin queue reaps all completions, and those exceed the batch or
+// belong to other threads are called back one by one
+int nvme_wait_completion_admin_batch(struct spdk_nvme_ctrlr* ctrlr,
+                                     struct cpl_batch* batch)
+{
+  batch->count = 0;
+  g_cpl_batch = batch;
+  spdk_nvme_ctrlr_process_admin_completions(ctrlr);
+  g_cpl_batch = NULL;
+  return cmd_log_cpl_count_take();
+}
+
+static void nvme_deallocate_ranges(struct spdk_nvme_dsm_range *ranges,
+                                   unsigned int count)
+{
+  for (unsigned int i=0; i<count; i++)
+  {
+    SPDK_DEBUGLOG(SPDK_LOG_NVME, "deallocate lba 0x%lx, count %d\n",
+                 ranges[i].starting_lba,
+                 ranges[i].length);
+    crc32_clear(ranges[i].starting_lba, ranges[i].length, 0, 0);
+  }
+}
+
+int nvme_send_cmd_raw(struct spdk_nvme_ctrlr* ctrlr,
+                      struct spdk_nvme_qpair *qpair,
+                      unsigned int opcode,
+                      unsigned int nsid,
+                      void* buf, size_t len,
+                      unsigned int cdw10,
+                      unsigned int cdw11,
+                      unsigned int cdw12,
+                      unsigned int cdw13,
+                      unsigned int cdw14,
+                      unsigned int cdw15,
+                      spdk_nvme_cmd_cb cb_fn,
+                      void* cb_arg)
+{
+  uint16_t qid;
+  struct spdk_nvme_cmd cmd;
+  struct cmd_log_entry_t* log_entry;
+
+  assert(ctrlr != NULL);
+
+  //setup cmd structure
+  memset(&cmd, 0, sizeof(struct spdk_nvme_cmd));
+  cmd.opc = opcode;
+  cmd.nsid = nsid;
+  cmd.cdw10 = cdw10;
+  cmd.cdw11 = cdw11;
+  cmd.cdw12 = cdw12;
+  cmd.cdw13 = cdw13;
+  cmd.cdw14 = cdw14;
+  cmd.cdw15 = cdw15;
+
+  qid = qpair ? qpair->id : 0;
+  log_entry = cmd_log_add_cmd(qid, NULL, 0, 0, 0,
+                              &cmd, cb_fn, cb_arg);
+
+  if (qpair)
+  {
+    // update host-side table for the trimed data
+    // other write-like operation updates crc32 table in driver wraper
+    if (opcode == 9)
+    {
+      nvme_deallocate_ranges(buf, cdw10+1);
+    }
+    
+    //send io cmd in qpair
+    return spdk_nvme_ctrlr_cmd_io_raw(ctrlr, qpair, &cmd, buf, len,
+                                      cmd_log_add_cpl_cb, log_entry);
+  }
+  else
+  {
+    //not qpair, admin cmd
+    return spdk_nvme_ctrlr_cmd_admin_raw(ctrlr, &cmd, buf, len,
+                                         cmd_log_add_cpl_cb, log_entry);
+  }
+}
+
+
+void nvme_register_aer_cb(struct spdk_nvme_ctrlr* ctrlr,
+                          spdk_nvme_aer_cb aer_cb,
+                          void* aer_cb_arg)
+{
+  spdk_nvme_ctrlr_register_aer_callback(ctrlr, aer_cb, aer_cb_arg);
+}
+
+void nvme_register_timeout_cb(struct spdk_nvme_ctrlr* ctrlr,
+                              spdk_nvme_timeout_cb timeout_cb,
+                              unsigned int timeout)
+{
+  spdk_nvme_ctrlr_register_timeout_callback(
+      ctrlr, (uint64_t)timeout*US_PER_S, timeout_cb, NULL);
+}
+
+int nvme_cpl_is_error(const struct spdk_nvme_cpl* cpl)
+{
+  return spdk_nvme_cpl_is_error(cpl);
+}
+
+
+////module: qpair
+///////////////////////////////
+
+struct spdk_nvme_qpair * qpair_create(struct spdk_nvme_ctrlr* ctrlr,
+                                      int prio, int depth)
+{
+  struct spdk_nvme_qpair* qpair;
+  struct spdk_nvme_io_qpair_opts opts;
+
+  //user options
+  opts.qprio = prio;
+  opts.io_queue_size = depth;
+  opts.io_queue_requests = depth*2;
+
+  qpair = spdk_nvme_ctrlr_alloc_io_qpair(ctrlr, &opts, sizeof(opts));
+  if (qpair == NULL)
+  {
+    SPDK_ERRLOG("alloc io qpair fail\n");
+    return NULL;
+  }
+
+  if (0 != cmd_log_table_create(qpair->id))
+  {
+    return NULL;
+  }
+
+  return qpair;
+}
+
+int qpair_wait_completion(struct spdk_nvme_qpair *qpair, uint32_t max_completions)
+{
+  return spdk_nvme_qpair_process_completions(qpair, max_completions);
+}
+
+// poll till expected completions are reaped, or usec elapsed
+int qpair_wait_completion_timed(struct spdk_nvme_qpair *qpair,
+                                uint32_t expected,
+                                uint32_t usec)
+{
+  int reaped = 0;
+  uint64_t end = spdk_get_ticks() + ns_to_ticks(usec*1000ULL);
+
+  do
+  {
+    // not reap more than expected
+    reaped += spdk_nvme_qpair_process_completions(qpair, expected-reaped);
+  } while (reaped < (int)expected && spdk_get_ticks() < end);
+
+  return reaped;
+}
+
+int qpair_wait_completion_batch(struct spdk_nvme_qpair *qpair,
+                                uint32_t max_completions,
+                                struct cpl_batch* batch)
+{
+  int ret;
+
+  assert(max_completions != 0 && max_completions <= batch->size);
+
+  batch->count = 0;
+  g_cpl_batch = batch;
+  ret = spdk_nvme_qpair_process_completions(qpair, max_completions);
+  g_cpl_batch = NULL;
+  return ret;
+}
+
+int qpair_get_id(struct spdk_nvme_qpair* q)
+{
+  // q NULL is admin queue
+  return q ? q->id : 0;
+}
+
+int qpair_free(struct spdk_nvme_qpair* q)
+{
+  if (q != NULL)
+  {
+    SPDK_DEBUGLOG(SPDK_LOG_NVME, "free qpair: %d\n", q->id);
+    cmd_log_table_delete(q->id);
+  }
+
+  return spdk_nvme_ctrlr_free_io_qpair(q);
+}
+
+
+////module: namespace
+///////////////////////////////
+
+struct spdk_nvme_ns* ns_init(struct spdk_nvme_ctrlr* ctrlr,
+                             uint32_t nsid,
+                             uint32_t crc_width)
+{
+  struct spdk_nvme_ns* ns = spdk_nvme_ctrlr_get_ns(ctrlr, nsid);
+  uint64_t nsze = spdk_nvme_ns_get_num_sectors(ns);
+
+  assert(ns != NULL);
+  if (crc_width != 32 && crc_width != 16 && crc_width != 8)
+  {
+    SPDK_ERRLOG("invalid crc width: %d\n", crc_width);
+    return NULL;
+  }
+
+  if (0 != memzone_reserve_shared_memory(ctrlr->trid.traddr, nsid, nsze, crc_width))
+  {
+    return NULL;
+  }
+  
+  return ns;
+}
+
+static int ns_cmd_read_write_verify(int is_read,
+                                    struct spdk_nvme_ns* ns,
+                                    struct spdk_nvme_qpair* qpair,
+                                    void* buf,
+                                    size_t len,
+                                    uint64_t lba,
+                                    uint16_t lba_count,
+                                    uint32_t io_flags,
+                                    bool verify,
+                                    spdk_nvme_cmd_cb cb_fn,
+                                    void* cb_arg)
+{
+  struct spdk_nvme_cmd cmd;
+  struct cmd_log_entry_t* log_entry;
+  uint32_t lba_size = spdk_nvme_ns_get_sector_size(ns);
+
+  assert(ns != NULL);
+  assert(qpair != NULL);
+
+  //only support 1 namespace now
+  assert(ns->id == 1);
+  
+  //validate data buffer
+  assert(buf != NULL);
+  assert(lba_size == 512);
+  assert(len >= lba_count*lba_size);
+
+  //setup cmd structure
+  memset(&cmd, 0, sizeof(struct spdk_nvme_cmd));
+  cmd.opc = is_read ? 2 : 1;
+  cmd.nsid = ns->id;
+  cmd.cdw10 = lba;
+  cmd.cdw11 = lba>>32;
+  cmd.cdw12 = (lba_count-1)+(io_flags<<16);
+  cmd.cdw13 = 0;
+  cmd.cdw14 = 0;
+  cmd.cdw15 = 0;
+
+  //fill write buffer with lba, token, and checksum
+  if (is_read != true)
+  {
+    //for write buffer
+    buffer_fill_data(buf, lba, lba_count, lba_size);
+  }
+
+  //get entry in cmd log, read data is verified at completion with buf
+  log_entry = cmd_log_add_cmd(qpair->id, verify ? buf : NULL,
+                              lba, lba_count, lba_size,
+                              &cmd, cb_fn, cb_arg);
+
+  //send io cmd in qpair
+  return spdk_nvme_ctrlr_cmd_io_raw(ns->ctrlr, qpair, &cmd, buf, len,
+                                    cmd_log_add_cpl_cb, log_entry);
+}
+
+int ns_cmd_read_write(int is_read,
+                      struct spdk_nvme_ns* ns,
+                      struct spdk_nvme_qpair* qpair,
+                      void* buf,
+                      size_t len,
+                      uint64_t lba,
+                      uint16_t lba_count,
+                      uint32_t io_flags,
+                      spdk_nvme_cmd_cb cb_fn,
+                      void* cb_arg)
+{
+  return ns_cmd_read_write_verify(is_read, ns, qpair, buf, len,
+                                  lba, lba_count, io_flags, true,
+                                  cb_fn, cb_arg);
+}
+
+// one outstanding command of a batch, recycled in a free list
+struct ns_batch_slot {
+  struct ns_batch* batch;
+  uint32_t index;
+  uint32_t next;
+};
+
+// allocated in heap with its slots, so it can outlive the call in timeout
+struct ns_batch {
+  struct ns_batch_slot* slots;
+  struct spdk_nvme_dsm_range* ranges;
+  uint64_t ranges_phys;
+  uint32_t qdepth;
+  uint32_t free;
+  uint32_t outstanding;
+  uint32_t error_count;
+  bool orphan;
+  uint16_t* status;
+  uint32_t* latency;
+  uint64_t time_cpl;
+};
+
+// count of timeout batches still waiting for late completions
+static uint32_t g_ns_batch_orphans = 0;
+
+static struct ns_batch* ns_batch_init(uint32_t qdepth)
+{
+  struct ns_batch* batch;
+
+  batch = calloc(1, sizeof(struct ns_batch)+sizeof(struct ns_batch_slot)*qdepth);
+  if (batch == NULL)
+  {
+    return NULL;
+  }
+
+  // dsm ranges of trim commands, one for each slot
+  batch->ranges = buffer_init(sizeof(struct spdk_nvme_dsm_range)*qdepth,
+                              &batch->ranges_phys);
+  if (batch->ranges == NULL)
+  {
+    free(batch);
+    return NULL;
+  }
+
+  batch->qdepth = qdepth;
+  batch->slots = (struct ns_batch_slot*)(batch+1);
+  for (uint32_t i=0; i<qdepth; i++)
+  {
+    batch->slots[i].batch = batch;
+    batch->slots[i].next = i+1;
+  }
+  batch->time_cpl = spdk_get_ticks();
+  return batch;
+}
+
+static void ns_batch_fini(struct ns_batch* batch)
+{
+  buffer_fini(batch->ranges,
+              sizeof(struct spdk_nvme_dsm_range)*batch->qdepth,
+              batch->ranges_phys);
+  free(batch);
+}
+
+static void ns_cmd_batch_cb(void* cb_arg, const struct spdk_nvme_cpl* cpl)
+{
+  struct ns_batch_slot* slot = (struct ns_batch_slot*)cb_arg;
+  struct ns_batch* batch = slot->batch;
+  uint16_t error = ((*(unsigned short*)(&cpl->status))>>1)&0x7ff;
+
+  batch->outstanding --;
+  if (batch->orphan)
+  {
+    // the caller has given up the batch in timeout, and its arrays are gone
+    if (batch->outstanding == 0)
+    {
+      ns_batch_fini(batch);
+      __atomic_fetch_sub(&g_ns_batch_orphans, 1, __ATOMIC_RELEASE);
+    }
+    return;
+  }
+
+  // latency in us is filled in cdw2 by cmd log
+  batch->status[slot->index] = error;
+  batch->latency[slot->index] = (&cpl->cdw0)[2];
+  if (error != 0)
+  {
+    batch->error_count ++;
+  }
+
+  batch->time_cpl = spdk_get_ticks();
+  slot->next = batch->free;
+  batch->free = slot - batch->slots;
+}
+
+// data bytes of the command in the buffer
+static inline size_t ns_cmd_batch_bytes(uint8_t op,
+                                        uint16_t lba_count,
+                                        uint32_t lba_size)
+{
+  if (op == IOWORKER_OP_READ ||
+      op == IOWORKER_OP_WRITE ||
+      op == IOWORKER_OP_COMPARE)
+  {
+    return (size_t)lba_count*lba_size;
+  }
+
+  return 0;
+}
+
+// send commands other than read and write, and keep crc table consistent.
+// The range of trim is filled in the given buffer.
+static int ns_cmd_send_one(struct spdk_nvme_ns* ns,
+                           struct spdk_nvme_qpair* qpair,
+                           uint8_t op,
+                           void* buf,
+                           struct spdk_nvme_dsm_range* range,
+                           uint64_t lba,
+                           uint16_t lba_count,
+                           spdk_nvme_cmd_cb cb_fn,
+                           void* cb_arg)
+{
+  switch (op)
+  {
+    case IOWORKER_OP_TRIM:
+      // one range, deallocated in crc table by nvme_send_cmd_raw()
+      memset(range, 0, sizeof(*range));
+      range->length = lba_count;
+      range->starting_lba = lba;
+      return nvme_send_cmd_raw(ns->ctrlr, qpair, 9, ns->id,
+                               range, sizeof(*range),
+                               0, 1<<2, 0, 0, 0, 0,
+                               cb_fn, cb_arg);
+
+    case IOWORKER_OP_WRITE_ZEROES:
+      crc32_clear(lba, lba_count, 0, 0);
+      return nvme_send_cmd_raw(ns->ctrlr, qpair, 8, ns->id, NULL, 0,
+                               lba, lba>>32, lba_count-1, 0, 0, 0,
+                               cb_fn, cb_arg);
+
+    case IOWORKER_OP_FLUSH:
+      return nvme_send_cmd_raw(ns->ctrlr, qpair, 0, ns->id, NULL, 0,
+                               0, 0, 0, 0, 0, 0,
+                               cb_fn, cb_arg);
+
+    case IOWORKER_OP_COMPARE:
+      return nvme_send_cmd_raw(ns->ctrlr, qpair, 5, ns->id,
+                               buf, lba_count*spdk_nvme_ns_get_sector_size(ns),
+                               lba, lba>>32, lba_count-1, 0, 0, 0,
+                               cb_fn, cb_arg);
+
+    default:
+      assert(false);
+      return -1;
+  }
+}
+
+static int ns_cmd_batch_one(struct spdk_nvme_ns* ns,
+                            struct spdk_nvme_qpair* qpair,
+                            uint8_t op,
+                            void* buf,
+                            uint64_t lba,
+                            uint16_t lba_count,
+                            struct ns_batch_slot* slot)
+{
+  struct ns_batch* batch = slot->batch;
+
+  if (op == IOWORKER_OP_READ || op == IOWORKER_OP_WRITE)
+  {
+    return ns_cmd_read_write_verify(op == IOWORKER_OP_READ, ns, qpair,
+                                    buf, lba_count*spdk_nvme_ns_get_sector_size(ns),
+                                    lba, lba_count, 0, true,
+                                    ns_cmd_batch_cb, slot);
+  }
+
+  return ns_cmd_send_one(ns, qpair, op, buf,
+                         &batch->ranges[slot - batch->slots],
+                         lba, lba_count,
+                         ns_cmd_batch_cb, slot);
+}
+
+// send count commands in one call, keeping at most qdepth outstanding.
+// Without offsets, data of commands are laid out back to back in buf.
+// Return the number of failed commands, -1 for invalid commands or
+// submission failure, -3 when no command completes in timeout seconds.
+int ns_cmd_batch(struct spdk_nvme_ns* ns,
+                 struct spdk_nvme_qpair* qpair,
+                 void* buf,
+                 size_t len,
+                 uint32_t count,
+                 const uint8_t* ops,
+                 const uint64_t* lbas,
+                 const uint16_t* lba_counts,
+                 const uint64_t* offsets,
+                 uint32_t qdepth,
+                 uint32_t timeout,
+                 uint16_t* status,
+                 uint32_t* latency)
+{
+  int ret = 0;
+  uint32_t next = 0;
+  uint64_t offset = 0;
+  uint32_t error_count;
+  struct ns_batch* batch;
+  uint32_t lba_size = spdk_nvme_ns_get_sector_size(ns);
+
+  assert(ns != NULL);
+  assert(qpair != NULL);
+  assert(status != NULL);
+  assert(latency != NULL);
+
+  // cmd log keeps all outstanding commands
+  if (qdepth == 0 || qdepth >= CMD_LOG_DEPTH)
+  {
+    SPDK_ERRLOG("invalid batch qdepth: %d\n", qdepth);
+    return -1;
+  }
+
+  // validate all commands before sending any of them
+  for (uint32_t i=0; i<count; i++)
+  {
+    size_t bytes = ns_cmd_batch_bytes(ops[i], lba_counts[i], lba_size);
+
+    if (ops[i] >= IOWORKER_OP_MAX ||
+        (ops[i] != IOWORKER_OP_FLUSH && lba_counts[i] == 0))
+    {
+      SPDK_ERRLOG("invalid command %d in batch: op %d, lba count %d\n",
+                  i, ops[i], lba_counts[i]);
+      return -1;
+    }
+
+    if (offsets != NULL)
+    {
+      offset = offsets[i];
+    }
+
+    if (bytes != 0 && (buf == NULL || offset+bytes > len))
+    {
+      SPDK_ERRLOG("command %d in batch exceeds the buffer: offset 0x%lx, bytes 0x%lx\n",
+                  i, offset, bytes);
+      return -1;
+    }
+
+    if (offsets == NULL)
+    {
+      offset += bytes;
+    }
+  }
+
+  batch = ns_batch_init(qdepth);
+  if (batch == NULL)
+  {
+    return -1;
+  }
+  batch->status = status;
+  batch->latency = latency;
+
+  offset = 0;
+  while (next < count || batch->outstanding != 0)
+  {
+    // keep the queue full
+    while (ret == 0 && next < count && batch->outstanding < qdepth)
+    {
+      struct ns_batch_slot* slot = &batch->slots[batch->free];
+
+      if (offsets != NULL)
+      {
+        offset = offsets[next];
+      }
+
+      batch->free = slot->next;
+      slot->index = next;
+      ret = ns_cmd_batch_one(ns, qpair, ops[next],
+                             (uint8_t*)buf+offset,
+                             lbas[next], lba_counts[next], slot);
+      if (ret != 0)
+      {
+        slot->next = batch->free;
+        batch->free = slot - batch->slots;
+        if (ret == -ENOMEM)
+        {
+          // no request available in the qpair, send it after completions
+          ret = 0;
+          break;
+        }
+
+        // reap the sent commands, and give up the rest
+        SPDK_ERRLOG("batch submission fail: %d, command %d\n", ret, next);
+        count = next;
+        break;
+      }
+
+      if (offsets == NULL)
+      {
+        offset += ns_cmd_batch_bytes(ops[next], lba_counts[next], lba_size);
+      }
+      batch->outstanding ++;
+      next ++;
+    }
+
+    spdk_nvme_qpair_process_completions(qpair, 0);
+
+    if (spdk_get_ticks() > batch->time_cpl + (uint64_t)timeout*g_driver_ticks_hz)
+    {
+      SPDK_ERRLOG("batch timeout: %d commands outstanding\n", batch->outstanding);
+      if (batch->outstanding == 0)
+      {
+        ns_batch_fini(batch);
+      }
+      else
+      {
+        // late completions only touch the batch, which is released by
+        // the last one
+        batch->orphan = true;
+        __atomic_fetch_add(&g_ns_batch_orphans, 1, __ATOMIC_RELAXED);
+      }
+      return -3;
+    }
+  }
+
+  error_count = batch->error_count;
+  ns_batch_fini(batch);
+  return ret != 0 ? -1 : (int)error_count;
+}
+
+uint32_t ns_cmd_batch_orphans(void)
+{
+  return __atomic_load_n(&g_ns_batch_orphans, __ATOMIC_ACQUIRE);
+}
+
+uint32_t ns_get_sector_size(struct spdk_nvme_ns* ns)
+{
+  return spdk_nvme_ns_get_sector_size(ns);
+}
+
+uint64_t ns_get_num_sectors(struct spdk_nvme_ns* ns)
+{
+  return spdk_nvme_ns_get_num_sectors(ns);
+}
+
+int ns_fini(struct spdk_nvme_ns* ns)
+{
+  crc32_fini();
+  return 0;
+}
+
+
+////module: ioworker
+///////////////////////////////
+
+// used for callback
+struct ioworker_io_ctx {
+  void* data_buf;
+  size_t data_buf_len;
+  uint64_t data_buf_phys;
+  bool is_read;
+  uint8_t op;
+  uint64_t lba;
+  uint16_t lba_count;
+  struct ioworker_size* size;
+  uint32_t phase_index;
+  int verify_ret;
+  uint64_t time_sent;
+  struct ioworker_global_ctx* gctx;
+};
+
+// read data is verified by helper threads when required. Completed read
+// io ctx is passed to a verifier thread through a single-producer
+// single-consumer ring, and returned to ioworker through another ring
+// after verification. The data buffer is not reused before that.
+#define IOWORKER_VERIFY_RING_SIZE   (CMD_LOG_DEPTH/2)
+#define IOWORKER_VERIFIER_MAX       (8)
+
+struct ioworker_verify_ring {
+  uint32_t head __attribute__((aligned(64)));
+  uint32_t tail __attribute__((aligned(64)));
+  struct ioworker_io_ctx* slot[IOWORKER_VERIFY_RING_SIZE] __attribute__((aligned(64)));
+};
+
+struct ioworker_verifier {
+  pthread_t thread;
+  uint32_t lba_size;
+  bool stop;
+  struct ioworker_verify_ring todo;
+  struct ioworker_verify_ring done;
+};
+
+// progress is published by the ioworker with a seqlock. The sequence is
+// odd when the block is being updated.
+struct ioworker_progress_block {
+  uint32_t seq;
+  struct ioworker_progress data;
+} __attribute__((aligned(64)));
+
+// constants of the LBA distribution, precomputed so sampling is O(1)
+struct ioworker_lba_dist {
+  uint64_t items;           // count of lba_align units in the region
+  double zipf_zetan;
+  double zipf_alpha;
+  double zipf_eta;
+  double zipf_second;       // 1+0.5^theta, the bound of the second item
+  double pareto_exp;
+  uint64_t hot_items;
+  double hot_probability;
+  double gauss_center;
+  double gauss_sigma;
+};
+
+struct ioworker_global_ctx {
+  struct ioworker_args* args;
+  struct ioworker_rets* rets;
+  struct ioworker_status* sts;
+  struct spdk_nvme_ns* ns;
+  struct spdk_nvme_qpair *qpair;
+  uint64_t time_start;
+  uint64_t due_time;
+  uint32_t iops;
+  uint32_t qdepth;
+  uint16_t read_percentage;
+  bool write_mixed;
+  uint64_t rng[4];
+  struct ioworker_lba_dist lba_dist;
+  struct ioworker_size* sizes;
+  uint32_t size_count;
+  uint32_t size_weight[IOWORKER_SIZE_MAX];
+  struct ioworker_size size_default;
+  struct ioworker_stream* streams;
+  uint32_t stream_count;
+  uint32_t stream_weight[IOWORKER_STREAM_MAX];
+  uint32_t stream_next;
+  bool stream_round_robin;
+  struct ioworker_op* ops;
+  struct ioworker_op op_default[IOWORKER_OP_MAX];
+  uint32_t op_weight[IOWORKER_OP_MAX];
+  bool op_mix;
+  struct ioworker_phase* phase;
+  uint32_t phase_index;
+  uint64_t phase_end;
+  uint64_t throttle_start;
+  uint64_t throttle_count;
+  struct ioworker_io_ctx** idle;
+  uint32_t idle_count;
+  uint64_t time_next_sec;
+  struct ioworker_latency* latency_read;
+  struct ioworker_latency* latency_write;
+  struct ioworker_progress_block* progress;
+  struct ioworker_latency* latency_recent;
+  uint64_t progress_interval;
+  uint64_t progress_next;
+  uint64_t progress_last;
+  uint64_t progress_io_read;
+  uint64_t progress_io_write;
+  uint64_t progress_bytes;
+  uint64_t io_bytes;
+  uint32_t sector_size;
+  int socket;
+  uint64_t io_count_till_last_sec;
+  uint64_t sequential_lba;
+  uint64_t io_count_sent;
+  uint64_t io_count_cplt;
+  uint64_t io_count_verifying;
+  uint32_t last_sec;
+  bool flag_finish;
+  struct ioworker_verifier* verifiers;
+  uint32_t verifier_count;
+  uint32_t verifier_next;
+  struct ioworker_io_ctx* io_ctx;
+};
+
+static int ioworker_send_one(struct spdk_nvme_ns* ns,
+                             struct spdk_nvme_qpair *qpair,
+                             struct ioworker_io_ctx* ctx,
+                             struct ioworker_global_ctx* gctx);
 
-struct cb_ctx {
-  struct spdk_nvme_transport_id* trid;
-  struct spdk_nvme_ctrlr* ctrlr;
-};
 
-static bool probe_cb(void *cb_ctx,
-                     const struct spdk_nvme_transport_id *trid,
-                     struct spdk_nvme_ctrlr_opts *opts)
+static bool ioworker_send_one_is_finish(struct ioworker_args* args,
+                                        struct ioworker_global_ctx* c)
 {
-  struct spdk_nvme_transport_id* target = ((struct cb_ctx*)cb_ctx)->trid;
+  // limit by io count, and/or time, which happens first
+  if (c->io_count_sent == args->io_count)
+  {
+    SPDK_DEBUGLOG(SPDK_LOG_NVME, "ioworker finish, sent %ld io\n", c->io_count_sent);
+    return true;
+  }
 
-  if (0 == spdk_nvme_transport_id_compare(target, trid))
+  assert(c->io_count_sent < args->io_count);
+  if (spdk_get_ticks() > c->due_time)
   {
-    SPDK_DEBUGLOG(SPDK_LOG_NVME, "Attaching to %s\n", trid->traddr);
+    SPDK_DEBUGLOG(SPDK_LOG_NVME, "ioworker finish, due time %ld ticks\n", c->due_time);
     return true;
   }
 
   return false;
 }
 
-
-static void attach_cb(void *cb_ctx,
-                      const struct spdk_nvme_transport_id *trid,
-                      struct spdk_nvme_ctrlr *ctrlr,
-                      const struct spdk_nvme_ctrlr_opts *opts)
+// IOPS is throttled by releasing io in the polling loop. The n-th io is
+// due at n/iops seconds after start, in ticks without accumulating error.
+static inline uint64_t ioworker_throttle_due(struct ioworker_global_ctx* gctx)
 {
-	const struct spdk_nvme_ctrlr_data *cdata = spdk_nvme_ctrlr_get_data(ctrlr);
-
-  SPDK_INFOLOG(SPDK_LOG_NVME,
-               "attached device %s: %s, %d namespaces, pid %d\n",
-               trid->traddr, cdata->mn,
-               spdk_nvme_ctrlr_get_num_ns(ctrlr),
-               getpid());
+  unsigned __int128 n = gctx->throttle_count;
 
-  ((struct cb_ctx*)cb_ctx)->ctrlr = ctrlr;
+  return gctx->throttle_start + n*g_driver_ticks_hz/gctx->iops;
 }
 
+static void ioworker_phase_start(struct ioworker_global_ctx* gctx,
+                                 uint32_t index,
+                                 uint64_t now)
+{
+  struct ioworker_phase* phase = &gctx->args->phases[index];
 
-////driver system
-///////////////////////////////
+  SPDK_DEBUGLOG(SPDK_LOG_NVME, "ioworker phase %d\n", index);
+  gctx->phase = phase;
+  gctx->phase_index = index;
+  gctx->phase_end = now + ns_to_ticks(phase->mseconds*1000*1000ULL);
+  gctx->iops = phase->iops;
+  gctx->qdepth = phase->qdepth;
+  gctx->read_percentage = phase->read_percentage;
 
-static_assert(DEBUG, "must enable DEBUG for more assert and check");
+  // restart the throttle in the new rate
+  gctx->throttle_start = now;
+  gctx->throttle_count = 0;
+}
 
-int driver_init(void)
+static inline void ioworker_phase_update(struct ioworker_global_ctx* gctx,
+                                         uint32_t index,
+                                         bool is_read,
+                                         uint64_t latency_ns)
 {
-  int ret = 0;
-  char buf[20];
-  struct spdk_env_opts opts;
+  // IOs are counted in the phase they were sent in
+  struct ioworker_phase* phase = &gctx->args->phases[index];
 
-  //init random sequence reproducible
-  srandom(1);
-  
-  // init cmd log and create one for admin queue
-  cmd_log_init();
-  ret = cmd_log_table_create(0);
-  if (ret != 0)
+  if (is_read)
   {
-    return ret;
+    phase->io_count_read ++;
+  }
+  else
+  {
+    phase->io_count_write ++;
   }
 
-  // distribute multiprocessing to different cores
-  spdk_env_opts_init(&opts);
-  sprintf(buf, "0x%x", 1<<(getpid()%get_nprocs()));
-  opts.core_mask = buf;
-  opts.shm_id = 0;
-  opts.name = "pynvme_driver";
-  opts.mem_size = 5892;
-  if (spdk_env_init(&opts) < 0)
+  phase->latency_sum_ns += latency_ns;
+  if (latency_ns > phase->latency_max_ns)
   {
-    fprintf(stderr, "Unable to initialize SPDK env\n");
-    return -1;
+    phase->latency_max_ns = latency_ns;
   }
+}
 
-  // log level setup
-  spdk_log_set_flag("nvme");
-  spdk_log_set_print_level(SPDK_LOG_INFO);
+static uint32_t ioworker_get_duration(struct ioworker_global_ctx* gctx)
+{
+  uint64_t usec = ticks_to_ns(spdk_get_ticks()-gctx->time_start)/1000;
 
-  return 0;
+  return (usec+500)/1000;
 }
 
-int driver_fini(void)
+static inline uint32_t ioworker_latency_index(uint64_t ns)
 {
-  //delete cmd log of admin queue
-  cmd_log_table_delete(0);
-  SPDK_DEBUGLOG(SPDK_LOG_NVME, "pynvme driver unloaded.\n");
-	return 0;
-}
+  uint32_t msb;
 
+  if (ns < (1ULL<<IOWORKER_LATENCY_SUB_BITS))
+  {
+    return ns;
+  }
 
-////module: pcie ctrlr
-///////////////////////////////
+  msb = 63 - __builtin_clzll(ns);
+  if (msb >= IOWORKER_LATENCY_MAX_BITS)
+  {
+    return IOWORKER_LATENCY_BUCKETS-1;
+  }
 
-struct spdk_pci_device* pcie_init(struct spdk_nvme_ctrlr* ctrlr)
-{
-  return spdk_nvme_ctrlr_get_pci_device(ctrlr);
+  return ((msb-IOWORKER_LATENCY_SUB_BITS+1) << IOWORKER_LATENCY_SUB_BITS) +
+    ((ns >> (msb-IOWORKER_LATENCY_SUB_BITS)) & ((1ULL<<IOWORKER_LATENCY_SUB_BITS)-1));
 }
 
-int pcie_cfg_read8(struct spdk_pci_device* pci,
-                   unsigned char* value,
-                   unsigned int offset)
+unsigned long ioworker_latency_bucket_ns(unsigned int index)
 {
-  return spdk_pci_device_cfg_read8(pci, value, offset);
+  uint32_t range = index >> IOWORKER_LATENCY_SUB_BITS;
+  uint64_t sub = index & ((1ULL<<IOWORKER_LATENCY_SUB_BITS)-1);
+
+  // the lowest latency of the bucket
+  assert(index < IOWORKER_LATENCY_BUCKETS);
+  if (range == 0)
+  {
+    return sub;
+  }
+
+  return (sub + (1ULL<<IOWORKER_LATENCY_SUB_BITS)) << (range-1);
 }
 
-int pcie_cfg_write8(struct spdk_pci_device* pci,
-                    unsigned char value,
-                    unsigned int offset)
+static inline void ioworker_latency_add(struct ioworker_latency* h,
+                                        uint64_t ns)
 {
-  return spdk_pci_device_cfg_write8(pci, value, offset);
-}
+  if (h->count == 0 || ns < h->min_ns)
+  {
+    h->min_ns = ns;
+  }
+  if (ns > h->max_ns)
+  {
+    h->max_ns = ns;
+  }
 
+  h->count ++;
+  h->sum_ns += ns;
+  h->sum_sq_ns += (double)ns*ns;
+  h->bucket[ioworker_latency_index(ns)] ++;
+}
 
-////module: nvme ctrlr
-///////////////////////////////
-struct spdk_nvme_ctrlr* nvme_probe(char * traddr)
+void ioworker_latency_merge(struct ioworker_latency* dst,
+                            const struct ioworker_latency* src)
 {
-  struct spdk_nvme_transport_id trid;
-  struct cb_ctx cb_ctx;
-	int rc;
-
-  SPDK_DEBUGLOG(SPDK_LOG_NVME, "looking for NVMe @%s\n", traddr);
+  if (src->count == 0)
+  {
+    return;
+  }
 
-  // device address
-  if (strchr(traddr, ':') != NULL)
+  if (dst->count == 0 || src->min_ns < dst->min_ns)
   {
-    // pcie address: contains ':' characters
-    trid.trtype = SPDK_NVME_TRANSPORT_PCIE;
-    strncpy(trid.traddr, traddr, strlen(traddr)+1);
+    dst->min_ns = src->min_ns;
   }
-  else
+  if (src->max_ns > dst->max_ns)
   {
-    // tcp/ip address: fixed port to 4420
-    trid.trtype = SPDK_NVME_TRANSPORT_TCP;
-    trid.adrfam = SPDK_NVMF_ADRFAM_IPV4;
-    strncpy(trid.traddr, traddr, strlen(traddr)+1);
-    strncpy(trid.trsvcid, "4420", 4+1);
+    dst->max_ns = src->max_ns;
   }
 
-  cb_ctx.trid = &trid;
-  cb_ctx.ctrlr = NULL;
-  rc = spdk_nvme_probe(&trid, &cb_ctx, probe_cb, attach_cb, NULL);
-  if (rc != 0 || cb_ctx.ctrlr == NULL)
+  dst->count += src->count;
+  dst->sum_ns += src->sum_ns;
+  dst->sum_sq_ns += src->sum_sq_ns;
+  for (uint32_t i=0; i<IOWORKER_LATENCY_BUCKETS; i++)
   {
-    SPDK_ERRLOG("not found device: %s, rc %d, cb_ctx.ctrlr %p\n",
-                trid.traddr, rc, cb_ctx.ctrlr);
-    return NULL;
+    dst->bucket[i] += src->bucket[i];
   }
-
-  return cb_ctx.ctrlr;
 }
 
-struct spdk_nvme_ctrlr* nvme_init(char * traddr)
+unsigned long ioworker_latency_percentile(const struct ioworker_latency* h,
+                                          double percentile)
 {
-  struct spdk_nvme_ctrlr* ctrlr;
+  uint64_t total = 0;
+  uint64_t target = ceil(h->count*percentile/100);
 
-  //enum the device
-  ctrlr = nvme_probe(traddr);
-  if (ctrlr == NULL)
+  if (h->count == 0)
   {
-    return NULL;
+    return 0;
   }
 
-  SPDK_DEBUGLOG(SPDK_LOG_NVME, "found device: %s\n", ctrlr->trid.traddr);
-  return ctrlr;
+  target = MAX(1, MIN(target, h->count));
+  if (target == h->count)
+  {
+    return h->max_ns;
+  }
+
+  for (uint32_t i=0; i<IOWORKER_LATENCY_BUCKETS; i++)
+  {
+    total += h->bucket[i];
+    if (total >= target)
+    {
+      // middle of the bucket, but never beyond the recorded range
+      uint64_t low = ioworker_latency_bucket_ns(i);
+      uint64_t high = (i+1 < IOWORKER_LATENCY_BUCKETS) ?
+                      ioworker_latency_bucket_ns(i+1) : h->max_ns+1;
+      uint64_t ns = low + (high-low-1)/2;
+
+      return MAX(h->min_ns, MIN(ns, h->max_ns));
+    }
+  }
+
+  return h->max_ns;
 }
 
-int nvme_fini(struct spdk_nvme_ctrlr* ctrlr)
+static inline uint64_t ioworker_latency_average(const struct ioworker_latency* h)
 {
-  SPDK_DEBUGLOG(SPDK_LOG_NVME, "free ctrlr: %s\n", ctrlr->trid.traddr);
+  return h->count ? h->sum_ns/h->count : 0;
+}
 
-  if (ctrlr == NULL)
+static void ioworker_latency_report(struct ioworker_global_ctx* gctx,
+                                    struct ioworker_args* args,
+                                    struct ioworker_rets* rets)
+{
+  double mean;
+  double variance;
+  struct ioworker_latency* all = malloc(sizeof(struct ioworker_latency));
+
+  assert(all != NULL);
+  memset(all, 0, sizeof(struct ioworker_latency));
+  ioworker_latency_merge(all, gctx->latency_read);
+  ioworker_latency_merge(all, gctx->latency_write);
+
+  rets->latency_max_us = all->max_ns/1000;
+  rets->latency_average_ns = ioworker_latency_average(all);
+  rets->latency_read_average_ns = ioworker_latency_average(gctx->latency_read);
+  rets->latency_write_average_ns = ioworker_latency_average(gctx->latency_write);
+  if (all->count != 0)
   {
-    return 0;
+    mean = (double)all->sum_ns/all->count;
+    variance = all->sum_sq_ns/all->count - mean*mean;
+    rets->latency_stddev_ns = variance > 0 ? sqrt(variance) : 0;
   }
 
-  // io qpairs should all be deleted before closing master controller 
-  if (true == spdk_process_is_primary() &&
-      false == TAILQ_EMPTY(&ctrlr->active_io_qpairs))
+  for (uint32_t i=0; i<args->percentile_count; i++)
   {
-    return -1;
+    args->percentile_latency_ns[i] =
+        ioworker_latency_percentile(all, args->percentiles[i]);
   }
-  
-  SPDK_DEBUGLOG(SPDK_LOG_NVME, "close device: %s\n", ctrlr->trid.traddr);
-  return spdk_nvme_detach(ctrlr);
-}
 
-int nvme_set_reg32(struct spdk_nvme_ctrlr* ctrlr,
-                   unsigned int offset,
-                   unsigned int value)
-{
-  return nvme_pcie_ctrlr_set_reg_4(ctrlr, offset, value);
+  free(all);
 }
 
-int nvme_get_reg32(struct spdk_nvme_ctrlr* ctrlr,
-                   unsigned int offset,
-                   unsigned int* value)
+static struct ioworker_latency* ioworker_latency_init(struct ioworker_latency* h)
 {
-  return nvme_pcie_ctrlr_get_reg_4(ctrlr, offset, value);
+  // use the histogram provided by caller, or a private one
+  if (h == NULL)
+  {
+    h = malloc(sizeof(struct ioworker_latency));
+    assert(h != NULL);
+  }
+
+  memset(h, 0, sizeof(struct ioworker_latency));
+  return h;
 }
 
-int nvme_wait_completion_admin(struct spdk_nvme_ctrlr* ctrlr)
+static void ioworker_latency_fini(struct ioworker_global_ctx* gctx)
 {
-  return spdk_nvme_ctrlr_process_admin_completions(ctrlr);
+  free(gctx->latency_recent);
+  gctx->latency_recent = NULL;
+
+  if (gctx->latency_read != gctx->args->latency_read)
+  {
+    free(gctx->latency_read);
+  }
+  if (gctx->latency_write != gctx->args->latency_write)
+  {
+    free(gctx->latency_write);
+  }
 }
 
-static void nvme_deallocate_ranges(struct spdk_nvme_dsm_range *ranges,
-                                   unsigned int count)
+static void ioworker_progress_update(struct ioworker_global_ctx* gctx,
+                                     uint64_t now,
+                                     bool finished)
 {
-  for (unsigned int i=0; i<count; i++)
+  struct ioworker_progress_block* p = gctx->progress;
+  struct ioworker_rets* rets = gctx->rets;
+  uint64_t interval_us = MAX(1, ticks_to_ns(now-gctx->progress_last)/1000);
+  uint64_t io_read = rets->io_count_read - gctx->progress_io_read;
+  uint64_t io_write = rets->io_count_write - gctx->progress_io_write;
+
+  // writer side of the seqlock, only this ioworker writes the block
+  __atomic_store_n(&p->seq, p->seq+1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  p->data.mseconds = ioworker_get_duration(gctx);
+  p->data.iops_read = io_read*US_PER_S/interval_us;
+  p->data.iops_write = io_write*US_PER_S/interval_us;
+  p->data.iops = p->data.iops_read + p->data.iops_write;
+  p->data.bandwidth = (gctx->io_bytes-gctx->progress_bytes)*US_PER_S/interval_us;
+  p->data.io_count_read = rets->io_count_read;
+  p->data.io_count_write = rets->io_count_write;
+  p->data.latency_p50_ns = ioworker_latency_percentile(gctx->latency_recent, 50);
+  p->data.latency_p99_ns = ioworker_latency_percentile(gctx->latency_recent, 99);
+  p->data.latency_max_ns = gctx->latency_recent->max_ns;
+  p->data.error = rets->error;
+  p->data.finished = finished;
+
+  __atomic_store_n(&p->seq, p->seq+1, __ATOMIC_RELEASE);
+
+  // start the next interval
+  memset(gctx->latency_recent, 0, sizeof(struct ioworker_latency));
+  gctx->progress_last = now;
+  gctx->progress_next = now + gctx->progress_interval;
+  gctx->progress_io_read = rets->io_count_read;
+  gctx->progress_io_write = rets->io_count_write;
+  gctx->progress_bytes = gctx->io_bytes;
+}
+
+static uint64_t ioworker_update_rets(struct ioworker_io_ctx* ctx,
+                                     struct ioworker_global_ctx* gctx,
+                                     uint64_t now)
+{
+  struct ioworker_rets* ret = gctx->rets;
+  struct ioworker_op* op = &gctx->ops[ctx->op];
+  uint64_t latency_ns = ticks_to_ns(now-ctx->time_sent);
+  // compare reads the media, and others modify it
+  bool is_read = (ctx->op == IOWORKER_OP_READ || ctx->op == IOWORKER_OP_COMPARE);
+  // only count bytes transferred in data buffers
+  uint64_t bytes = (is_read || ctx->op == IOWORKER_OP_WRITE) ?
+                   ctx->lba_count*gctx->sector_size : 0;
+
+  op->io_count ++;
+  op->latency_sum_ns += latency_ns;
+  if (latency_ns > op->latency_max_ns)
   {
-    SPDK_DEBUGLOG(SPDK_LOG_NVME, "deallocate lba 0x%lx, count %d\n",
-                 ranges[i].starting_lba,
-                 ranges[i].length);
-    crc32_clear(ranges[i].starting_lba, ranges[i].length, 0, 0);
+    op->latency_max_ns = latency_ns;
+  }
+
+  gctx->io_bytes += bytes;
+  ctx->size->io_count ++;
+  ctx->size->io_bytes += bytes;
+  ctx->size->latency_sum_ns += latency_ns;
+  if (latency_ns > ctx->size->latency_max_ns)
+  {
+    ctx->size->latency_max_ns = latency_ns;
+  }
+  if (gctx->phase != NULL)
+  {
+    ioworker_phase_update(gctx, ctx->phase_index, is_read, latency_ns);
+  }
+  if (gctx->latency_recent != NULL)
+  {
+    ioworker_latency_add(gctx->latency_recent, latency_ns);
+  }
+
+  if (is_read == true)
+  {
+    ret->io_count_read ++;
+    ioworker_latency_add(gctx->latency_read, latency_ns);
+  }
+  else
+  {
+    ret->io_count_write ++;
+    ioworker_latency_add(gctx->latency_write, latency_ns);
   }
+
+  return latency_ns;
 }
 
-int nvme_send_cmd_raw(struct spdk_nvme_ctrlr* ctrlr,
-                      struct spdk_nvme_qpair *qpair,
-                      unsigned int opcode,
-                      unsigned int nsid,
-                      void* buf, size_t len,
-                      unsigned int cdw10,
-                      unsigned int cdw11,
-                      unsigned int cdw12,
-                      unsigned int cdw13,
-                      unsigned int cdw14,
-                      unsigned int cdw15,
-                      spdk_nvme_cmd_cb cb_fn,
-                      void* cb_arg)
+static inline void ioworker_update_io_count_per_second(
+    struct ioworker_global_ctx* gctx, 
+    struct ioworker_args* args,
+    struct ioworker_rets* rets)
 {
-  uint16_t qid;
-  struct spdk_nvme_cmd cmd;
-  struct cmd_log_entry_t* log_entry;
+  uint64_t current_io_count = rets->io_count_read + rets->io_count_write;
+  
+  // update to next second
+  gctx->time_next_sec += g_driver_ticks_hz;
+  args->io_counter_per_second[gctx->last_sec ++] = current_io_count - gctx->io_count_till_last_sec;
+  gctx->io_count_till_last_sec = current_io_count;
+}
 
-  assert(ctrlr != NULL);
+static void ioworker_one_error(struct ioworker_global_ctx* gctx,
+                               uint16_t error)
+{
+  struct ioworker_rets* rets = gctx->rets;
 
-  //setup cmd structure
-  memset(&cmd, 0, sizeof(struct spdk_nvme_cmd));
-  cmd.opc = opcode;
-  cmd.nsid = nsid;
-  cmd.cdw10 = cdw10;
-  cmd.cdw11 = cdw11;
-  cmd.cdw12 = cdw12;
-  cmd.cdw13 = cdw13;
-  cmd.cdw14 = cdw14;
-  cmd.cdw15 = cdw15;
+  // terminate ioworker when any error happen
+  SPDK_DEBUGLOG(SPDK_LOG_NVME, "ioworker error happen in cpl\n");
+
+  if (error == 0x0281 && gctx->write_mixed)
+  {
+    // read/write mix, ignore read data verify result 02/81,
+  }
+  else
+  {
+    gctx->flag_finish = true;
+
+    // only keep the first error code
+    if (rets->error == 0)
+    {
+      rets->error = error;
+    }
+  }
+}
 
-  qid = qpair ? qpair->id : 0;
-  log_entry = cmd_log_add_cmd(qid, NULL, 0, 0, 0,
-                              &cmd, cb_fn, cb_arg);
+static void ioworker_one_next(struct ioworker_io_ctx* ctx)
+{
+  struct ioworker_global_ctx* gctx = ctx->gctx;
 
-  if (qpair)
+  // check if all io are sent
+  if (gctx->flag_finish != true)
   {
-    // update host-side table for the trimed data
-    // other write-like operation updates crc32 table in driver wraper
-    if (opcode == 9)
+    //update finish flag
+    gctx->flag_finish = ioworker_send_one_is_finish(gctx->args, gctx);
+  }
+
+  if (gctx->flag_finish != true)
+  {
+    if (gctx->iops != 0 ||
+        gctx->io_count_sent-gctx->io_count_cplt >= gctx->qdepth)
     {
-      nvme_deallocate_ranges(buf, cdw10+1);
+      // io is released later in the polling loop
+      gctx->idle[gctx->idle_count++] = ctx;
+      return;
     }
-    
-    //send io cmd in qpair
-    return spdk_nvme_ctrlr_cmd_io_raw(ctrlr, qpair, &cmd, buf, len,
-                                      cmd_log_add_cpl_cb, log_entry);
+
+    // send more io
+    ioworker_send_one(gctx->ns, gctx->qpair, ctx, gctx);
   }
-  else
+}
+
+static void ioworker_idle_release(struct ioworker_global_ctx* gctx)
+{
+  uint64_t now = spdk_get_ticks();
+
+  while (gctx->idle_count != 0 && gctx->flag_finish != true)
   {
-    //not qpair, admin cmd
-    return spdk_nvme_ctrlr_cmd_admin_raw(ctrlr, &cmd, buf, len,
-                                         cmd_log_add_cpl_cb, log_entry);
+    // time may run out while all io are waiting
+    gctx->flag_finish = ioworker_send_one_is_finish(gctx->args, gctx);
+    if (gctx->flag_finish == true ||
+        gctx->io_count_sent-gctx->io_count_cplt >= gctx->qdepth ||
+        (gctx->iops != 0 && now < ioworker_throttle_due(gctx)))
+    {
+      break;
+    }
+
+    gctx->throttle_count ++;
+    ioworker_send_one(gctx->ns, gctx->qpair,
+                      gctx->idle[--gctx->idle_count], gctx);
   }
 }
 
-
-void nvme_register_aer_cb(struct spdk_nvme_ctrlr* ctrlr,
-                          spdk_nvme_aer_cb aer_cb,
-                          void* aer_cb_arg)
+static inline bool ioworker_verify_ring_push(struct ioworker_verify_ring* r,
+                                             struct ioworker_io_ctx* ctx)
 {
-  spdk_nvme_ctrlr_register_aer_callback(ctrlr, aer_cb, aer_cb_arg);
+  uint32_t tail = r->tail;
+
+  if (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == IOWORKER_VERIFY_RING_SIZE)
+  {
+    return false;
+  }
+
+  r->slot[tail % IOWORKER_VERIFY_RING_SIZE] = ctx;
+  __atomic_store_n(&r->tail, tail+1, __ATOMIC_RELEASE);
+  return true;
 }
 
-void nvme_register_timeout_cb(struct spdk_nvme_ctrlr* ctrlr,
-                              spdk_nvme_timeout_cb timeout_cb,
-                              unsigned int timeout)
+static inline struct ioworker_io_ctx* ioworker_verify_ring_pop(struct ioworker_verify_ring* r)
 {
-  spdk_nvme_ctrlr_register_timeout_callback(
-      ctrlr, (uint64_t)timeout*US_PER_S, timeout_cb, NULL);
+  struct ioworker_io_ctx* ctx;
+  uint32_t head = r->head;
+
+  if (head == __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE))
+  {
+    return NULL;
+  }
+
+  ctx = r->slot[head % IOWORKER_VERIFY_RING_SIZE];
+  __atomic_store_n(&r->head, head+1, __ATOMIC_RELEASE);
+  return ctx;
 }
 
-int nvme_cpl_is_error(const struct spdk_nvme_cpl* cpl)
+static void* ioworker_verifier_thread(void* arg)
 {
-  return spdk_nvme_cpl_is_error(cpl);
-}
+  struct ioworker_verifier* v = (struct ioworker_verifier*)arg;
+  struct ioworker_io_ctx* ctx;
+
+  while (__atomic_load_n(&v->stop, __ATOMIC_ACQUIRE) != true)
+  {
+    ctx = ioworker_verify_ring_pop(&v->todo);
+    if (ctx == NULL)
+    {
+      sched_yield();
+      continue;
+    }
 
+    ctx->verify_ret = buffer_verify_data(ctx->data_buf, ctx->lba,
+                                         ctx->lba_count, v->lba_size);
 
-////module: qpair
-///////////////////////////////
+    // done ring has the same size as todo ring, never full
+    while (!ioworker_verify_ring_push(&v->done, ctx));
+  }
 
-struct spdk_nvme_qpair * qpair_create(struct spdk_nvme_ctrlr* ctrlr,
-                                      int prio, int depth)
+  return NULL;
+}
+
+static int ioworker_verifier_init(struct ioworker_global_ctx* gctx,
+                                  unsigned int count,
+                                  uint32_t lba_size)
 {
-  struct spdk_nvme_qpair* qpair;
-  struct spdk_nvme_io_qpair_opts opts;
+  cpu_set_t cpuset;
+  pthread_attr_t attr;
+  int cpu = sched_getcpu();
 
-  //user options
-  opts.qprio = prio;
-  opts.io_queue_size = depth;
-  opts.io_queue_requests = depth*2;
+  assert(count <= IOWORKER_VERIFIER_MAX);
 
-  qpair = spdk_nvme_ctrlr_alloc_io_qpair(ctrlr, &opts, sizeof(opts));
-  if (qpair == NULL)
+  // rings and threads in host memory, hugepages are left for data buffers
+  if (0 != posix_memalign((void**)&gctx->verifiers, 64,
+                          sizeof(struct ioworker_verifier)*count))
   {
-    SPDK_ERRLOG("alloc io qpair fail\n");
-    return NULL;
+    gctx->verifiers = NULL;
+    return -1;
   }
+  memset(gctx->verifiers, 0, sizeof(struct ioworker_verifier)*count);
 
-  if (0 != cmd_log_table_create(qpair->id))
+  // keep verifiers away from the core polling the qpair
+  CPU_ZERO(&cpuset);
+  for (int i=0; i<get_nprocs(); i++)
   {
-    return NULL;
+    if (i != cpu || get_nprocs() == 1)
+    {
+      CPU_SET(i, &cpuset);
+    }
   }
+  pthread_attr_init(&attr);
+  pthread_attr_setaffinity_np(&attr, sizeof(cpuset), &cpuset);
 
-  return qpair;
-}
+  for (unsigned int i=0; i<count; i++)
+  {
+    struct ioworker_verifier* v = &gctx->verifiers[i];
 
-int qpair_wait_completion(struct spdk_nvme_qpair *qpair, uint32_t max_completions)
-{
-  return spdk_nvme_qpair_process_completions(qpair, max_completions);
-}
+    v->lba_size = lba_size;
+    if (0 != pthread_create(&v->thread, &attr, ioworker_verifier_thread, v))
+    {
+      SPDK_ERRLOG("fail to create verifier thread %d\n", i);
+      break;
+    }
+    gctx->verifier_count ++;
+  }
 
-int qpair_get_id(struct spdk_nvme_qpair* q)
-{
-  // q NULL is admin queue
-  return q ? q->id : 0;
+  pthread_attr_destroy(&attr);
+  return gctx->verifier_count == count ? 0 : -1;
 }
 
-int qpair_free(struct spdk_nvme_qpair* q)
+static void ioworker_verifier_fini(struct ioworker_global_ctx* gctx)
 {
-  if (q != NULL)
+  for (unsigned int i=0; i<gctx->verifier_count; i++)
   {
-    SPDK_DEBUGLOG(SPDK_LOG_NVME, "free qpair: %d\n", q->id);
-    cmd_log_table_delete(q->id);
+    __atomic_store_n(&gctx->verifiers[i].stop, true, __ATOMIC_RELEASE);
+    pthread_join(gctx->verifiers[i].thread, NULL);
   }
 
-  return spdk_nvme_ctrlr_free_io_qpair(q);
+  free(gctx->verifiers);
+  gctx->verifiers = NULL;
+  gctx->verifier_count = 0;
 }
 
+static inline void ioworker_verifier_send(struct ioworker_global_ctx* gctx,
+                                          struct ioworker_io_ctx* ctx)
+{
+  struct ioworker_verifier* v = &gctx->verifiers[gctx->verifier_next];
 
-////module: namespace
-///////////////////////////////
+  // io in verification is less than qdepth, todo ring is never full
+  gctx->verifier_next = (gctx->verifier_next+1) % gctx->verifier_count;
+  gctx->io_count_verifying ++;
+  while (!ioworker_verify_ring_push(&v->todo, ctx));
+}
 
-struct spdk_nvme_ns* ns_init(struct spdk_nvme_ctrlr* ctrlr, uint32_t nsid)
+static void ioworker_verifier_reap(struct ioworker_global_ctx* gctx)
 {
-  struct spdk_nvme_ns* ns = spdk_nvme_ctrlr_get_ns(ctrlr, nsid);
-  uint64_t nsze = spdk_nvme_ns_get_num_sectors(ns);
+  struct ioworker_io_ctx* ctx;
 
-  assert(ns != NULL);
-  if (0 != memzone_reserve_shared_memory(sizeof(uint32_t)*nsze))
+  for (unsigned int i=0; i<gctx->verifier_count; i++)
   {
-    return NULL;
+    while ((ctx = ioworker_verify_ring_pop(&gctx->verifiers[i].done)) != NULL)
+    {
+      gctx->io_count_verifying --;
+      if (ctx->verify_ret != 0)
+      {
+        // same as the status set by cmd log when verify in cpl
+        SPDK_WARNLOG("ioworker read data verify fail, lba %ld, ret %d\n",
+                     ctx->lba, ctx->verify_ret);
+        ioworker_one_error(gctx, 0x0281);
+      }
+
+      // data buffer is free to use again
+      ioworker_one_next(ctx);
+    }
   }
-  
-  return ns;
 }
 
-int ns_cmd_read_write(int is_read,
-                      struct spdk_nvme_ns* ns,
-                      struct spdk_nvme_qpair* qpair,
-                      void* buf,
-                      size_t len,
-                      uint64_t lba,
-                      uint16_t lba_count,
-                      uint32_t io_flags,
-                      spdk_nvme_cmd_cb cb_fn,
-                      void* cb_arg)
+static void ioworker_one_cb(void* ctx_in, const struct spdk_nvme_cpl *cpl)
 {
-  struct spdk_nvme_cmd cmd;
-  struct cmd_log_entry_t* log_entry;
-  uint32_t lba_size = spdk_nvme_ns_get_sector_size(ns);
+  uint64_t now;
+  struct ioworker_io_ctx* ctx = (struct ioworker_io_ctx*)ctx_in;
+  struct ioworker_args* args = ctx->gctx->args;
+  struct ioworker_global_ctx* gctx = ctx->gctx;
+  struct ioworker_rets* rets = gctx->rets;
 
-  assert(ns != NULL);
-  assert(qpair != NULL);
+  SPDK_DEBUGLOG(SPDK_LOG_NVME, "one io completed, ctx %p\n", ctx);
 
-  //only support 1 namespace now
-  assert(ns->id == 1);
-  
-  //validate data buffer
-  assert(buf != NULL);
-  assert(lba_size == 512);
-  assert(len >= lba_count*lba_size);
+  gctx->io_count_cplt ++;
+  gctx->sts->io_count_cplt = gctx->io_count_cplt;
 
-  //setup cmd structure
-  memset(&cmd, 0, sizeof(struct spdk_nvme_cmd));
-  cmd.opc = is_read ? 2 : 1;
-  cmd.nsid = ns->id;
-  cmd.cdw10 = lba;
-  cmd.cdw11 = lba>>32;
-  cmd.cdw12 = (lba_count-1)+(io_flags<<16);
-  cmd.cdw13 = 0;
-  cmd.cdw14 = 0;
-  cmd.cdw15 = 0;
+  // update statistics in ret structure
+  now = spdk_get_ticks();
+  ioworker_update_rets(ctx, gctx, now);
 
-  //fill write buffer with lba, token, and checksum
-  if (is_read != true)
+  if (true == nvme_cpl_is_error(cpl))
   {
-    //for write buffer
-    buffer_fill_data(buf, lba, lba_count, lba_size);
+    uint16_t error = ((*(unsigned short*)(&cpl->status))>>1)&0x7ff;
+
+    // compare data is not prepared, so miscompare is expected
+    gctx->ops[ctx->op].error_count ++;
+    if (error != 0x0285 || ctx->op != IOWORKER_OP_COMPARE)
+    {
+      ioworker_one_error(gctx, error);
+    }
   }
 
-  //get entry in cmd log
-  log_entry = cmd_log_add_cmd(qpair->id, buf, lba, lba_count, lba_size,
-                              &cmd, cb_fn, cb_arg);
+  // update io counter per second when required
+  if (args->io_counter_per_second != NULL)
+  {
+    if (now > gctx->time_next_sec)
+    {
+      ioworker_update_io_count_per_second(gctx, args, rets);
+    }
+  }
 
-  //send io cmd in qpair
-  return spdk_nvme_ctrlr_cmd_io_raw(ns->ctrlr, qpair, &cmd, buf, len,
-                                    cmd_log_add_cpl_cb, log_entry);
+  // hand over good read data to verifiers, and reuse the buffer later
+  if (gctx->verifier_count != 0 && ctx->is_read &&
+      false == nvme_cpl_is_error(cpl))
+  {
+    ioworker_verifier_send(gctx, ctx);
+    return;
+  }
+
+  ioworker_one_next(ctx);
 }
 
-uint32_t ns_get_sector_size(struct spdk_nvme_ns* ns)
+static inline uint64_t ioworker_random_rotl(uint64_t x, int k)
 {
-  return spdk_nvme_ns_get_sector_size(ns);
+  return (x << k) | (x >> (64 - k));
 }
 
-uint64_t ns_get_num_sectors(struct spdk_nvme_ns* ns)
+static uint64_t ioworker_random_splitmix(uint64_t* x)
 {
-  return spdk_nvme_ns_get_num_sectors(ns);
+  uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
 }
 
-int ns_fini(struct spdk_nvme_ns* ns)
+static void ioworker_random_init(struct ioworker_global_ctx* gctx, uint64_t seed)
 {
-  crc32_fini();
-  return 0;
+  // expand the 64-bit seed to the whole state, never all zero
+  for (int i=0; i<4; i++)
+  {
+    gctx->rng[i] = ioworker_random_splitmix(&seed);
+  }
 }
 
+// xoshiro256**, the state is private to the ioworker process
+static inline uint64_t ioworker_random(struct ioworker_global_ctx* gctx)
+{
+  uint64_t* s = gctx->rng;
+  uint64_t ret = ioworker_random_rotl(s[1] * 5, 7) * 9;
+  uint64_t t = s[1] << 17;
 
-////module: ioworker
-///////////////////////////////
-
-// used for callback
-struct ioworker_io_ctx {
-  void* data_buf;
-  size_t data_buf_len;
-  bool is_read;
-  struct timeval time_sent;
-  struct ioworker_global_ctx* gctx;
-};
-
-struct ioworker_global_ctx {
-  struct ioworker_args* args;
-  struct ioworker_rets* rets;
-  struct ioworker_status* sts;
-  struct spdk_nvme_ns* ns;
-  struct spdk_nvme_qpair *qpair;
-  struct timeval due_time;
-  struct timeval io_due_time;
-  struct timeval io_delay_time;
-  struct timeval time_next_sec;
-  uint64_t io_count_till_last_sec;
-  uint64_t sequential_lba;
-  uint64_t io_count_sent;
-  uint64_t io_count_cplt;
-  uint32_t last_sec;
-  bool flag_finish;
-};
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = ioworker_random_rotl(s[3], 45);
+  return ret;
+}
 
-#define ALIGN_UP(n, a)    (((n)%(a))?((n)+(a)-((n)%(a))):((n)))
-#define ALIGN_DOWN(n, a)  ((n)-((n)%(a)))
+// unbiased random number in [0, range), by Lemire's multiply-and-reject
+static uint64_t ioworker_random_range(struct ioworker_global_ctx* gctx,
+                                      uint64_t range)
+{
+  unsigned __int128 m;
+  uint64_t low;
+  uint64_t threshold;
 
-static int ioworker_send_one(struct spdk_nvme_ns* ns,
-                             struct spdk_nvme_qpair *qpair,
-                             struct ioworker_io_ctx* ctx,
-                             struct ioworker_global_ctx* gctx);
+  assert(range != 0);
+  m = (unsigned __int128)ioworker_random(gctx) * range;
+  low = (uint64_t)m;
+  if (low < range)
+  {
+    threshold = -range % range;
+    while (low < threshold)
+    {
+      m = (unsigned __int128)ioworker_random(gctx) * range;
+      low = (uint64_t)m;
+    }
+  }
 
+  return m >> 64;
+}
 
-static inline void timeradd_second(struct timeval* now,
-                                     unsigned int seconds,
-                                     struct timeval* due)
+// uniform double in [0, 1) from the top 53 bits
+static inline double ioworker_random_double(struct ioworker_global_ctx* gctx)
 {
-  struct timeval duration;
-
-  duration.tv_sec = seconds;
-  duration.tv_usec = 0;
-  timeradd(now, &duration, due);
+  return (ioworker_random(gctx) >> 11) * 0x1.0p-53;
 }
 
-static bool ioworker_send_one_is_finish(struct ioworker_args* args,
-                                        struct ioworker_global_ctx* c)
+// sum of 1/i^theta for i in [1, n]. The first terms are summed directly and
+// the tail is approximated by Euler-Maclaurin, which is accurate to ~1e-9
+// here and costs no more on a namespace of billions of LBAs.
+static double ioworker_lba_zeta(uint64_t n, double theta)
 {
-  struct timeval now;
+  const uint64_t head = MIN(n, 1024ULL);
+  double sum = 0;
 
-  // limit by io count, and/or time, which happens first
-  if (c->io_count_sent == args->io_count)
+  for (uint64_t i=1; i<=head; i++)
   {
-    SPDK_DEBUGLOG(SPDK_LOG_NVME, "ioworker finish, sent %ld io\n", c->io_count_sent);
-    return true;
+    sum += pow(i, -theta);
   }
 
-  assert(c->io_count_sent < args->io_count);
-  gettimeofday(&now, NULL);
-  if (true == timercmp(&now, &c->due_time, >))
+  if (n > head)
   {
-    SPDK_DEBUGLOG(SPDK_LOG_NVME, "ioworker finish, due time %ld us\n", c->due_time.tv_usec);
-    return true;
+    double a = head;
+    double b = n;
+
+    sum += (pow(b, 1-theta) - pow(a, 1-theta))/(1-theta);
+    sum += (pow(b, -theta) - pow(a, -theta))/2;
+    sum -= theta*(pow(b, -theta-1) - pow(a, -theta-1))/12;
   }
 
-  return false;
+  return sum;
 }
 
-static void ioworker_one_io_throttle(struct ioworker_global_ctx* gctx,
-                                     struct timeval* now)
+static void ioworker_lba_dist_init(struct ioworker_global_ctx* gctx)
 {
-  struct timeval diff;
-  struct timeval* tv = &gctx->io_due_time;
+  struct ioworker_args* args = gctx->args;
+  struct ioworker_lba_dist* dist = &gctx->lba_dist;
+  uint64_t n = (args->region_end-args->region_start)/args->lba_align;
+  double theta = args->lba_theta;
+
+  dist->items = MAX(n, 1ULL);
+  switch (args->lba_random)
+  {
+    case IOWORKER_LBA_ZIPF:
+      // Gray et al., Quickly Generating Billion-Record Synthetic Databases
+      dist->zipf_zetan = ioworker_lba_zeta(dist->items, theta);
+      dist->zipf_alpha = 1/(1-theta);
+      dist->zipf_eta = (1-pow(2.0/dist->items, 1-theta)) /
+                       (1-ioworker_lba_zeta(2, theta)/dist->zipf_zetan);
+      dist->zipf_second = 1+pow(0.5, theta);
+      break;
+
+    case IOWORKER_LBA_PARETO:
+      // theta of IO goes to the first 1-theta of the region: x = u^(1/a),
+      // and the cdf x^a meets theta at 1-theta
+      dist->pareto_exp = log(1-theta)/log(theta);
+      break;
 
-  SPDK_DEBUGLOG(SPDK_LOG_NVME, "this io due at %ld.%06ld\n", tv->tv_sec, tv->tv_usec);
-  if (true == timercmp(&gctx->io_due_time, now, >))
-  {
-    //delay usec to meet the IOPS prequisit
-    timersub(&gctx->io_due_time, now, &diff);
-    usleep(timeval_to_us(&diff));
-  }
+    case IOWORKER_LBA_HOTCOLD:
+      dist->hot_items = MAX(dist->items*args->lba_hot_fraction, 1.0);
+      dist->hot_items = MIN(dist->hot_items, dist->items);
+      dist->hot_probability = args->lba_hot_probability;
+      break;
 
-  timeradd(&gctx->io_due_time, &gctx->io_delay_time, &gctx->io_due_time);
-}
+    case IOWORKER_LBA_GAUSSIAN:
+      dist->gauss_center = dist->items*args->lba_center;
+      dist->gauss_sigma = dist->items*args->lba_sigma;
+      break;
 
-static uint32_t ioworker_get_duration(struct timeval* start,
-                                      struct ioworker_global_ctx* gctx)
-{
-  struct timeval now;
-  struct timeval diff;
-  uint32_t msec;
-  
-  gettimeofday(&now, NULL);
-  timersub(&now, start, &diff);
-  msec = diff.tv_sec * 1000UL;
-  return msec + (diff.tv_usec+500)/1000;
+    default:
+      break;
+  }
 }
 
-static uint32_t ioworker_update_rets(struct ioworker_io_ctx* ctx,
-                                     struct ioworker_rets* ret,
-                                     struct timeval* now)
+static uint64_t ioworker_lba_zipf(struct ioworker_global_ctx* gctx)
 {
-  struct timeval diff;
-  uint32_t latency;
+  struct ioworker_lba_dist* dist = &gctx->lba_dist;
+  double u = ioworker_random_double(gctx);
+  double uz = u*dist->zipf_zetan;
+  uint64_t ret;
 
-  timersub(now, &ctx->time_sent, &diff);
-  latency = timeval_to_us(&diff);
-  if (latency > ret->latency_max_us)
+  if (uz < 1)
   {
-    ret->latency_max_us = latency;
+    return 0;
   }
 
-  if (ctx->is_read == true)
-  {
-    ret->io_count_read ++;
-  }
-  else
+  if (uz < dist->zipf_second)
   {
-    ret->io_count_write ++;
+    return 1;
   }
 
-  return latency;
+  ret = dist->items*pow(dist->zipf_eta*u-dist->zipf_eta+1, dist->zipf_alpha);
+  return MIN(ret, dist->items-1);
 }
 
-static inline void ioworker_update_io_count_per_second(
-    struct ioworker_global_ctx* gctx, 
-    struct ioworker_args* args,
-    struct ioworker_rets* rets)
+static uint64_t ioworker_lba_gaussian(struct ioworker_global_ctx* gctx)
 {
-  uint64_t current_io_count = rets->io_count_read + rets->io_count_write;
-  
-  // update to next second
-  timeradd_second(&gctx->time_next_sec, 1, &gctx->time_next_sec);
-  args->io_counter_per_second[gctx->last_sec ++] = current_io_count - gctx->io_count_till_last_sec;
-  gctx->io_count_till_last_sec = current_io_count;
-}
+  struct ioworker_lba_dist* dist = &gctx->lba_dist;
+  double x;
 
-static void ioworker_one_cb(void* ctx_in, const struct spdk_nvme_cpl *cpl)
-{
-  uint32_t latency_us;
-  struct timeval now;
-  struct ioworker_io_ctx* ctx = (struct ioworker_io_ctx*)ctx_in;
-  struct ioworker_args* args = ctx->gctx->args;
-  struct ioworker_global_ctx* gctx = ctx->gctx;
-  struct ioworker_rets* rets = gctx->rets;
+  // Box-Muller, resample the tail outside of the region
+  do
+  {
+    double u1 = 1-ioworker_random_double(gctx);
+    double u2 = ioworker_random_double(gctx);
 
-  SPDK_DEBUGLOG(SPDK_LOG_NVME, "one io completed, ctx %p, io delay time: %ld\n",
-               ctx, gctx->io_delay_time.tv_usec);
+    x = dist->gauss_center +
+        dist->gauss_sigma*sqrt(-2*log(u1))*cos(2*M_PI*u2);
+  } while (x < 0 || x >= dist->items);
 
-  gctx->io_count_cplt ++;
-  gctx->sts->io_count_cplt = gctx->io_count_cplt;
+  return x;
+}
 
-  // update statistics in ret structure
-  gettimeofday(&now, NULL);
-  latency_us = ioworker_update_rets(ctx, rets, &now);
+// index of the lba_align unit in the region
+static uint64_t ioworker_lba_item(struct ioworker_global_ctx* gctx)
+{
+  struct ioworker_lba_dist* dist = &gctx->lba_dist;
+  uint64_t ret;
 
-  // update io count per latency
-  if (args->io_counter_per_latency != NULL)
-  {
-    args->io_counter_per_latency[MIN(US_PER_S-1, latency_us)] ++;
-  }
-  
-  // throttle IOPS by delay
-  if (gctx->io_delay_time.tv_usec != 0)
+  switch (gctx->args->lba_random)
   {
-    ioworker_one_io_throttle(gctx, &now);
-  }
+    case IOWORKER_LBA_ZIPF:
+      return ioworker_lba_zipf(gctx);
 
-  if (true == nvme_cpl_is_error(cpl))
-  {
-    uint16_t error = ((*(unsigned short*)(&cpl->status))>>1)&0x7ff;
-    
-    // terminate ioworker when any error happen
-    SPDK_DEBUGLOG(SPDK_LOG_NVME, "ioworker error happen in cpl\n");
+    case IOWORKER_LBA_PARETO:
+      ret = dist->items*pow(ioworker_random_double(gctx), dist->pareto_exp);
+      return MIN(ret, dist->items-1);
 
-    if (error == 0x0281 && args->read_percentage < 100)
-    {
-      // read/write mix, ignore read data verify result 02/81,
-    }
-    else
-    {
-      gctx->flag_finish = true;
-    
-      // only keep the first error code
-      if (rets->error == 0)
+    case IOWORKER_LBA_HOTCOLD:
+      if (dist->hot_items == dist->items ||
+          ioworker_random_double(gctx) < dist->hot_probability)
       {
-        rets->error = error;
+        return ioworker_random_range(gctx, dist->hot_items);
       }
-    }
-  }
+      return dist->hot_items +
+             ioworker_random_range(gctx, dist->items-dist->hot_items);
 
-  // update io counter per second when required
-  if (args->io_counter_per_second != NULL)
-  {
-    if (true == timercmp(&now, &gctx->time_next_sec, >))
-    {
-      ioworker_update_io_count_per_second(gctx, args, rets);
-    }
-  }
+    case IOWORKER_LBA_GAUSSIAN:
+      return ioworker_lba_gaussian(gctx);
 
-  // check if all io are sent
-  if (gctx->flag_finish != true)
-  {
-    //update finish flag
-    gctx->flag_finish = ioworker_send_one_is_finish(args, gctx);
+    default:
+      assert(false);
+      return 0;
   }
+}
 
-  if (gctx->flag_finish != true)
+static inline bool ioworker_send_one_is_read(struct ioworker_global_ctx* gctx)
+{
+  return ioworker_random_range(gctx, 100) < gctx->read_percentage;
+}
+
+static uint8_t ioworker_send_one_op(struct ioworker_global_ctx* gctx)
+{
+  uint32_t i;
+  uint32_t w;
+
+  if (gctx->op_mix == false)
   {
-    // send more io
-    ioworker_send_one(gctx->ns, gctx->qpair, ctx, gctx);
+    return ioworker_send_one_is_read(gctx) ? IOWORKER_OP_READ : IOWORKER_OP_WRITE;
   }
+
+  // op_weight is the cumulative weight of the table
+  w = ioworker_random_range(gctx, gctx->op_weight[IOWORKER_OP_MAX-1]);
+  for (i=0; w >= gctx->op_weight[i]; i++);
+  return i;
 }
 
-static inline bool ioworker_send_one_is_read(unsigned short read_percentage)
+static struct ioworker_size* ioworker_send_one_size(struct ioworker_global_ctx* gctx)
 {
-  return random()%100 < read_percentage;
+  uint32_t i;
+  uint32_t w;
+
+  if (gctx->size_count == 1)
+  {
+    return gctx->sizes;
+  }
+
+  // size_weight is the cumulative weight of the table
+  w = ioworker_random_range(gctx, gctx->size_weight[gctx->size_count-1]);
+  for (i=0; w >= gctx->size_weight[i]; i++);
+  return &gctx->sizes[i];
 }
 
 static uint64_t ioworker_send_one_lba_sequential(struct ioworker_args* args,
-                                                 struct ioworker_global_ctx* gctx)
+                                                 struct ioworker_global_ctx* gctx,
+                                                 uint16_t lba_align)
 {
   uint64_t ret;
 
-  SPDK_DEBUGLOG(SPDK_LOG_NVME, "gctx lba: %ld, align:%d\n", gctx->sequential_lba, args->lba_align);
-  ret = gctx->sequential_lba + args->lba_align;
+  SPDK_DEBUGLOG(SPDK_LOG_NVME, "gctx lba: %ld, align:%d\n", gctx->sequential_lba, lba_align);
+  ret = gctx->sequential_lba + lba_align;
   if (ret > args->region_end)
   {
     ret = args->region_start;
@@ -1087,27 +3220,72 @@ static uint64_t ioworker_send_one_lba_sequential(struct ioworker_args* args,
   return ret;
 }
 
-static inline uint64_t ioworker_send_one_lba_random(struct ioworker_args* args)
+static uint64_t ioworker_send_one_lba_stream(struct ioworker_global_ctx* gctx,
+                                             uint16_t lba_align)
+{
+  uint32_t i;
+  uint64_t ret;
+  struct ioworker_stream* stream;
+
+  // interleave the streams in turn when they are weighted evenly
+  if (gctx->stream_round_robin)
+  {
+    i = gctx->stream_next++;
+    if (gctx->stream_next == gctx->stream_count)
+    {
+      gctx->stream_next = 0;
+    }
+  }
+  else
+  {
+    uint32_t w = ioworker_random_range(gctx, gctx->stream_weight[gctx->stream_count-1]);
+    for (i=0; w >= gctx->stream_weight[i]; i++);
+  }
+
+  // each stream has its own cursor, which is the lba of its next io
+  stream = &gctx->streams[i];
+  ret = ALIGN_DOWN(stream->lba, lba_align);
+  stream->lba = ret + lba_align;
+  if (stream->lba > stream->region_end)
+  {
+    stream->lba = stream->region_start;
+  }
+  stream->io_count ++;
+
+  return ret;
+}
+
+static inline uint64_t ioworker_send_one_lba_random(struct ioworker_args* args,
+                                                    struct ioworker_global_ctx* gctx)
 {
-  return (random()%(args->region_end-args->region_start)) + args->region_start;
+  return ioworker_random_range(gctx, args->region_end-args->region_start) + args->region_start;
 }
 
 static uint64_t ioworker_send_one_lba(struct ioworker_args* args,
-                                      struct ioworker_global_ctx* gctx)
+                                      struct ioworker_global_ctx* gctx,
+                                      uint16_t lba_align)
 {
   uint64_t ret;
 
-  if (args->lba_random == 0)
+  if (args->lba_random == IOWORKER_LBA_SEQUENTIAL && gctx->stream_count != 0)
+  {
+    ret = ioworker_send_one_lba_stream(gctx, lba_align);
+  }
+  else if (args->lba_random == IOWORKER_LBA_SEQUENTIAL)
   {
-    ret = ioworker_send_one_lba_sequential(args, gctx);
+    ret = ioworker_send_one_lba_sequential(args, gctx, lba_align);
     gctx->sequential_lba = ret;
   }
+  else if (args->lba_random == IOWORKER_LBA_UNIFORM)
+  {
+    ret = ioworker_send_one_lba_random(args, gctx);
+  }
   else
   {
-    ret = ioworker_send_one_lba_random(args);
+    ret = args->region_start + ioworker_lba_item(gctx)*args->lba_align;
   }
 
-  return ALIGN_DOWN(ret, args->lba_align);
+  return ALIGN_DOWN(ret, lba_align);
 }
 
 static int ioworker_send_one(struct spdk_nvme_ns* ns,
@@ -1117,18 +3295,30 @@ static int ioworker_send_one(struct spdk_nvme_ns* ns,
 {
   int ret;
   struct ioworker_args* args = gctx->args;
-  bool is_read = ioworker_send_one_is_read(args->read_percentage);
-  uint64_t lba_starting = ioworker_send_one_lba(args, gctx);
-  uint16_t lba_count = args->lba_size;
+  uint8_t op = ioworker_send_one_op(gctx);
+  bool is_read = (op == IOWORKER_OP_READ);
+  struct ioworker_size* size = ioworker_send_one_size(gctx);
+  uint64_t lba_starting = ioworker_send_one_lba(args, gctx, size->lba_align);
+  uint16_t lba_count = size->lba_size;
 
   SPDK_DEBUGLOG(SPDK_LOG_NVME, "sending one io, ctx %p, lba %ld\n", ctx, lba_starting);
   assert(ctx->data_buf != NULL);
 
-  ret = ns_cmd_read_write(is_read, ns, qpair,
-                          ctx->data_buf, ctx->data_buf_len,
+  if (op == IOWORKER_OP_READ || op == IOWORKER_OP_WRITE)
+  {
+    ret = ns_cmd_read_write_verify(is_read, ns, qpair,
+                                   ctx->data_buf, lba_count*gctx->sector_size,
+                                   lba_starting, lba_count,
+                                   0,  //do not have more options in ioworkers
+                                   gctx->verifier_count == 0,
+                                   ioworker_one_cb, ctx);
+  }
+  else
+  {
+    ret = ns_cmd_send_one(ns, qpair, op, ctx->data_buf, ctx->data_buf,
                           lba_starting, lba_count,
-                          0,  //do not have more options in ioworkers
                           ioworker_one_cb, ctx);
+  }
   if (ret != 0)
   {
     SPDK_DEBUGLOG(SPDK_LOG_NVME, "ioworker error happen in cpl\n");
@@ -1140,32 +3330,45 @@ static int ioworker_send_one(struct spdk_nvme_ns* ns,
   gctx->io_count_sent ++;
   gctx->sts->io_count_sent = gctx->io_count_sent;
   ctx->is_read = is_read;
-  gettimeofday(&ctx->time_sent, NULL);
+  ctx->op = op;
+  ctx->lba = lba_starting;
+  ctx->lba_count = lba_count;
+  ctx->size = size;
+  ctx->phase_index = gctx->phase_index;
+  ctx->time_sent = spdk_get_ticks();
   return 0;
 }
 
 struct ioworker_status ioworker_get_status(unsigned int wid)
 {
-  return g_ioworker_status_table[wid];
+  return g_ioworker_status_table[wid].sts;
 }
 
-int ioworker_entry(struct spdk_nvme_ns* ns,
-                   struct spdk_nvme_qpair *qpair,
-                   struct ioworker_args* args,
-                   struct ioworker_rets* rets)
+// check args, init the global ctx, and send the first batch of IOs
+static int ioworker_start(struct ioworker_global_ctx* gctx,
+                          struct spdk_nvme_ns* ns,
+                          struct spdk_nvme_qpair *qpair,
+                          struct ioworker_args* args,
+                          struct ioworker_rets* rets)
 {
-  int ret = 0;
   uint64_t nsze = spdk_nvme_ns_get_num_sectors(ns);
   uint32_t sector_size = spdk_nvme_ns_get_sector_size(ns);
-  struct timeval test_start;
-  struct ioworker_global_ctx gctx;
   struct ioworker_io_ctx* io_ctx = malloc(sizeof(struct ioworker_io_ctx)*args->qdepth);
 
   //init rets
   rets->io_count_read = 0;
   rets->io_count_write = 0;
   rets->latency_max_us = 0;
+  rets->latency_average_ns = 0;
+  rets->latency_stddev_ns = 0;
+  rets->latency_read_average_ns = 0;
+  rets->latency_write_average_ns = 0;
   rets->mseconds = 0;
+  rets->seed = 0;
+  rets->core = sched_getcpu();
+  rets->numa_node = spdk_env_get_socket_id(rets->core);
+  rets->device_numa_node = spdk_pci_device_get_socket_id(
+      spdk_nvme_ctrlr_get_pci_device(ns->ctrlr));
   rets->error = 0;
 
   SPDK_DEBUGLOG(SPDK_LOG_NVME, "args.lba_start = %ld\n", args->lba_start);
@@ -1180,6 +3383,10 @@ int ioworker_entry(struct spdk_nvme_ns* ns,
   SPDK_DEBUGLOG(SPDK_LOG_NVME, "args.seconds = %d\n", args->seconds);
   SPDK_DEBUGLOG(SPDK_LOG_NVME, "args.qdepth = %d\n", args->qdepth);
   SPDK_DEBUGLOG(SPDK_LOG_NVME, "args.wid = %d\n", args->wid);
+  SPDK_DEBUGLOG(SPDK_LOG_NVME, "args.seed = %ld\n", args->seed);
+  SPDK_DEBUGLOG(SPDK_LOG_NVME, "ioworker on core %d of node %d, device on node %d\n",
+                rets->core, rets->numa_node, rets->device_numa_node);
+  SPDK_DEBUGLOG(SPDK_LOG_NVME, "args.verify_threads = %d\n", args->verify_threads);
 
   //check args
   assert(ns != NULL);
@@ -1187,10 +3394,51 @@ int ioworker_entry(struct spdk_nvme_ns* ns,
   assert(args->io_count != 0 || args->seconds != 0);
   assert(args->seconds < 24*3600ULL);
   assert(args->lba_size != 0);
+  assert(args->lba_random >= IOWORKER_LBA_SEQUENTIAL &&
+         args->lba_random <= IOWORKER_LBA_GAUSSIAN);
+  assert(args->lba_random != IOWORKER_LBA_ZIPF ||
+         (args->lba_theta > 0 && args->lba_theta < 1));
+  assert(args->lba_random != IOWORKER_LBA_PARETO ||
+         (args->lba_theta > 0.5 && args->lba_theta < 1));
+  assert(args->lba_random != IOWORKER_LBA_HOTCOLD ||
+         (args->lba_hot_fraction > 0 && args->lba_hot_fraction <= 1 &&
+          args->lba_hot_probability >= 0 && args->lba_hot_probability <= 1));
+  assert(args->lba_random != IOWORKER_LBA_GAUSSIAN ||
+         (args->lba_center >= 0 && args->lba_center <= 1 && args->lba_sigma > 0));
   assert(args->region_start < args->region_end);
   assert(args->read_percentage >= 0);
   assert(args->read_percentage <= 100);
   assert(args->qdepth <= CMD_LOG_DEPTH/2);
+  assert(args->verify_threads <= IOWORKER_VERIFIER_MAX);
+  assert(args->percentile_count == 0 ||
+         (args->percentiles != NULL && args->percentile_latency_ns != NULL));
+  assert(args->size_count <= IOWORKER_SIZE_MAX);
+  assert(args->size_count == 0 || args->sizes != NULL);
+  for (unsigned int i=0; i<args->size_count; i++)
+  {
+    // buffers are allocated for the largest size in lba_size
+    assert(args->sizes[i].lba_size != 0);
+    assert(args->sizes[i].lba_size <= args->lba_size);
+    assert(args->sizes[i].lba_align != 0);
+    assert(args->lba_align%args->sizes[i].lba_align == 0);
+    assert(args->sizes[i].weight != 0);
+  }
+  assert(args->stream_count <= IOWORKER_STREAM_MAX);
+  assert(args->stream_count == 0 || args->streams != NULL);
+  for (unsigned int i=0; i<args->stream_count; i++)
+  {
+    assert(args->streams[i].region_start < args->streams[i].region_end);
+    assert(args->streams[i].weight != 0);
+  }
+  assert(args->phase_count <= IOWORKER_PHASE_MAX);
+  assert(args->phase_count == 0 || args->phases != NULL);
+  for (unsigned int i=0; i<args->phase_count; i++)
+  {
+    assert(args->phases[i].mseconds != 0);
+    assert(args->phases[i].read_percentage <= 100);
+    assert(args->phases[i].qdepth != 0);
+    assert(args->phases[i].qdepth <= args->qdepth);
+  }
 
   // check io size
   if (args->lba_size*sector_size > ns->ctrlr->max_xfer_size)
@@ -1228,92 +3476,425 @@ int ioworker_entry(struct spdk_nvme_ns* ns,
   {
     args->qdepth = args->io_count;
   }
+  for (unsigned int i=0; i<args->stream_count; i++)
+  {
+    //adjust stream regions as the whole region
+    struct ioworker_stream* stream = &args->streams[i];
+
+    stream->region_end = MIN(stream->region_end, nsze);
+    stream->region_start = ALIGN_UP(stream->region_start, args->lba_align);
+    if (stream->region_end < stream->region_start + args->lba_size + args->lba_align)
+    {
+      SPDK_ERRLOG("stream %d region is too small\n", i);
+      rets->error = 0x0002;  // Invalid Field in Command
+      free(io_ctx);
+      return -2;
+    }
+    stream->region_end = ALIGN_DOWN(stream->region_end - args->lba_size - 1, args->lba_align);
+    stream->lba = stream->region_start;
+    stream->io_count = 0;
+  }
 
   //init global ctx
-  memset(&gctx, 0, sizeof(gctx));
-  gctx.ns = ns;
-  gctx.qpair = qpair;
-  gctx.sequential_lba = args->lba_start;
-  gctx.io_count_sent = 0;
-  gctx.io_count_cplt = 0;
-  gctx.flag_finish = false;
-  gctx.args = args;
-  gctx.rets = rets;
-  gettimeofday(&test_start, NULL);
-  timeradd_second(&test_start, args->seconds, &gctx.due_time);
-  gctx.io_delay_time.tv_sec = 0;
-  gctx.io_delay_time.tv_usec = args->iops ? US_PER_S/args->iops : 0;
-  timeradd(&test_start, &gctx.io_delay_time, &gctx.io_due_time);
-  timeradd_second(&test_start, 1, &gctx.time_next_sec);
-  gctx.io_count_till_last_sec = 0;
-  gctx.last_sec = 0;
+  memset(gctx, 0, sizeof(*gctx));
+  gctx->ns = ns;
+  gctx->qpair = qpair;
+  gctx->sequential_lba = args->lba_start;
+  gctx->io_count_sent = 0;
+  gctx->io_count_cplt = 0;
+  gctx->flag_finish = false;
+  gctx->args = args;
+  gctx->rets = rets;
+  gctx->latency_read = ioworker_latency_init(args->latency_read);
+  gctx->latency_write = ioworker_latency_init(args->latency_write);
+  gctx->sector_size = sector_size;
+  // data buffers are in the memory close to the device
+  gctx->socket = rets->device_numa_node;
+  gctx->time_start = spdk_get_ticks();
+  gctx->due_time = gctx->time_start + args->seconds*g_driver_ticks_hz;
+  gctx->throttle_start = gctx->time_start;
+  gctx->throttle_count = 0;
+  gctx->idle = malloc(sizeof(struct ioworker_io_ctx*)*args->qdepth);
+  gctx->idle_count = 0;
+  gctx->iops = args->iops;
+  gctx->qdepth = args->qdepth;
+  gctx->read_percentage = args->read_percentage;
+  gctx->write_mixed = (args->read_percentage < 100);
+  // different workers get different sequences unless seeded explicitly
+  rets->seed = args->seed ? args->seed : args->wid+1;
+  ioworker_random_init(gctx, rets->seed);
+  ioworker_lba_dist_init(gctx);
+  gctx->streams = args->streams;
+  gctx->stream_count = args->stream_count;
+  gctx->stream_next = 0;
+  gctx->stream_round_robin = true;
+  for (unsigned int i=0; i<gctx->stream_count; i++)
+  {
+    gctx->stream_weight[i] = gctx->streams[i].weight + (i ? gctx->stream_weight[i-1] : 0);
+    if (gctx->streams[i].weight != gctx->streams[0].weight)
+    {
+      gctx->stream_round_robin = false;
+    }
+  }
+  for (unsigned int i=0; i<args->phase_count; i++)
+  {
+    // phase statistics are accumulated when the schedule repeats
+    args->phases[i].io_count_read = 0;
+    args->phases[i].io_count_write = 0;
+    args->phases[i].latency_sum_ns = 0;
+    args->phases[i].latency_max_ns = 0;
+    args->phases[i].qdepth = MIN(args->phases[i].qdepth, args->qdepth);
+    gctx->write_mixed |= (args->phases[i].read_percentage < 100);
+  }
+  if (args->phase_count != 0)
+  {
+    ioworker_phase_start(gctx, 0, gctx->time_start);
+  }
+  if (args->phase_once)
+  {
+    // stop at the end of the schedule, instead of the whole seconds
+    uint64_t schedule_ms = 0;
+
+    for (unsigned int i=0; i<args->phase_count; i++)
+    {
+      schedule_ms += args->phases[i].mseconds;
+    }
+    gctx->due_time = gctx->time_start + ns_to_ticks(schedule_ms*1000*1000ULL);
+  }
+
+  // single io size is a table of one entry
+  gctx->size_default.lba_size = args->lba_size;
+  gctx->size_default.lba_align = args->lba_align;
+  gctx->size_default.weight = 1;
+  gctx->sizes = &gctx->size_default;
+  gctx->size_count = 1;
+  if (args->size_count != 0)
+  {
+    gctx->sizes = args->sizes;
+    gctx->size_count = args->size_count;
+  }
+  for (unsigned int i=0; i<gctx->size_count; i++)
+  {
+    gctx->sizes[i].io_count = 0;
+    gctx->sizes[i].io_bytes = 0;
+    gctx->sizes[i].latency_sum_ns = 0;
+    gctx->sizes[i].latency_max_ns = 0;
+    gctx->size_weight[i] = gctx->sizes[i].weight + (i ? gctx->size_weight[i-1] : 0);
+  }
+  // statistics are kept per op, with or without the op mix table
+  gctx->ops = args->ops ? args->ops : gctx->op_default;
+  gctx->op_mix = false;
+  for (unsigned int i=0; i<IOWORKER_OP_MAX; i++)
+  {
+    gctx->ops[i].io_count = 0;
+    gctx->ops[i].error_count = 0;
+    gctx->ops[i].latency_sum_ns = 0;
+    gctx->ops[i].latency_max_ns = 0;
+    gctx->op_weight[i] = gctx->ops[i].weight + (i ? gctx->op_weight[i-1] : 0);
+    gctx->op_mix |= (gctx->ops[i].weight != 0);
+  }
+  if (gctx->op_mix)
+  {
+    // the op mix takes place of read_percentage
+    gctx->write_mixed = (gctx->ops[IOWORKER_OP_WRITE].weight != 0 ||
+                        gctx->ops[IOWORKER_OP_TRIM].weight != 0 ||
+                        gctx->ops[IOWORKER_OP_WRITE_ZEROES].weight != 0);
+  }
+  gctx->time_next_sec = gctx->time_start + g_driver_ticks_hz;
+  gctx->io_count_till_last_sec = 0;
+  gctx->last_sec = 0;
 
   //find the status address
   assert(g_ioworker_status_table != NULL);
-  gctx.sts = &g_ioworker_status_table[args->wid];
+  gctx->sts = &g_ioworker_status_table[args->wid].sts;
   SPDK_INFOLOG(SPDK_LOG_NVME, "ioworker id %d, status table: %p\n",
-               args->wid, gctx.sts);
+               args->wid, gctx->sts);
+
+  // publish progress in the interval
+  if (args->progress != NULL && args->progress_interval_ms != 0)
+  {
+    gctx->progress = args->progress;
+    gctx->latency_recent = ioworker_latency_init(NULL);
+    gctx->progress_interval = ns_to_ticks(args->progress_interval_ms*1000*1000ULL);
+    gctx->progress_last = gctx->time_start;
+    gctx->progress_next = gctx->time_start + gctx->progress_interval;
+  }
+
+  // start verifier threads before sending any io
+  if (args->verify_threads != 0 &&
+      0 != ioworker_verifier_init(gctx, args->verify_threads, sector_size))
+  {
+    SPDK_ERRLOG("fail to start verifier threads\n");
+    ioworker_verifier_fini(gctx);
+    ioworker_latency_fini(gctx);
+    rets->error = 0x0006;  // Internal Error
+    free(gctx->idle);
+    free(io_ctx);
+    return -4;
+  }
   
   // sending the first batch of IOs, all remaining IOs are sending
-  // in callbacks till end
+  // in callbacks till end. IOs beyond the queue depth of the phase, or
+  // throttled by IOPS, are released in the polling loop.
   for (unsigned int i=0; i<args->qdepth; i++)
   {
     io_ctx[i].data_buf_len = args->lba_size * sector_size;
-    io_ctx[i].data_buf = buffer_init(io_ctx[i].data_buf_len, NULL);
-    io_ctx[i].gctx = &gctx;
-    ioworker_send_one(ns, qpair, &io_ctx[i], &gctx);
+    io_ctx[i].data_buf = buffer_init_socket(io_ctx[i].data_buf_len,
+                                            &io_ctx[i].data_buf_phys,
+                                            gctx->socket);
+    io_ctx[i].gctx = gctx;
+    gctx->idle[gctx->idle_count++] = &io_ctx[i];
+  }
+  gctx->io_ctx = io_ctx;
+  ioworker_idle_release(gctx);
+  return 0;
+}
+
+// one round of polling, returns 1 when the ioworker is still running.
+// Callbacks check the end condition and mark the flag. Check the flag
+// here if it is time to stop the ioworker and return the statistics data
+static int ioworker_poll(struct ioworker_global_ctx* gctx,
+                         uint32_t max_completions)
+{
+  struct ioworker_args* args = gctx->args;
+
+  if (gctx->io_count_sent == gctx->io_count_cplt &&
+      gctx->io_count_verifying == 0 &&
+      gctx->flag_finish == true)
+  {
+    return 0;
+  }
+
+  //exceed 10 seconds more than the expected test time, abort ioworker
+  if (ioworker_get_duration(gctx) >
+      args->seconds*1000UL + 10*1000UL)
+  {
+    //generic error
+    return -3;
+  }
+
+  // collect completions
+  spdk_nvme_qpair_process_completions(gctx->qpair, max_completions);
+
+  // collect verified read data
+  ioworker_verifier_reap(gctx);
+
+  // switch to the next phase, and repeat the schedule unless it runs once
+  if (gctx->phase != NULL && spdk_get_ticks() > gctx->phase_end &&
+      !(args->phase_once && gctx->phase_index+1 == args->phase_count))
+  {
+    ioworker_phase_start(gctx,
+                         (gctx->phase_index+1)%args->phase_count,
+                         spdk_get_ticks());
   }
 
-  // callbacks check the end condition and mark the flag. Check the
-  // flag here if it is time to stop the ioworker and return the
-  // statistics data
-  while (gctx.io_count_sent != gctx.io_count_cplt ||
-         gctx.flag_finish != true)
+  // release throttled io when they are due
+  ioworker_idle_release(gctx);
+
+  // publish progress
+  if (gctx->progress != NULL)
   {
-    //exceed 10 seconds more than the expected test time, abort ioworker
-    if (ioworker_get_duration(&test_start, &gctx) >
-        args->seconds*1000UL + 10*1000UL)
+    uint64_t now = spdk_get_ticks();
+
+    if (now > gctx->progress_next)
     {
-      //generic error
-      ret = -3;
-      break;
+      ioworker_progress_update(gctx, now, false);
     }
+  }
 
-    // collect completions
-    spdk_nvme_qpair_process_completions(qpair, 0);
+  return 1;
+}
+
+// report the statistics, and release resources of the ioworker
+static int ioworker_stop(struct ioworker_global_ctx* gctx, int ret)
+{
+  struct ioworker_args* args = gctx->args;
+  struct ioworker_rets* rets = gctx->rets;
+  struct ioworker_io_ctx* io_ctx = gctx->io_ctx;
+
+  // final duration and latency
+  rets->mseconds = ioworker_get_duration(gctx);
+  ioworker_latency_report(gctx, args, rets);
+  memcpy(rets->ops, gctx->ops, sizeof(rets->ops));
+  if (gctx->progress != NULL)
+  {
+    ioworker_progress_update(gctx, spdk_get_ticks(), true);
   }
+  ioworker_latency_fini(gctx);
 
-  // final duration
-  rets->mseconds = ioworker_get_duration(&test_start, &gctx);
+  // buffers are not used by verifiers any more
+  if (gctx->verifier_count != 0)
+  {
+    ioworker_verifier_fini(gctx);
+  }
 
   //release io ctx
   for (unsigned int i=0; i<args->qdepth; i++)
   {
-    buffer_fini(io_ctx[i].data_buf);
+    buffer_fini_socket(io_ctx[i].data_buf, io_ctx[i].data_buf_len,
+                       io_ctx[i].data_buf_phys, gctx->socket);
   }
 
+  free(gctx->idle);
   free(io_ctx);
   return ret;
 }
 
-//TODO: ioworker progress indicates work percentage in ioworker's
-//process to the main process
+int ioworker_entry(struct spdk_nvme_ns* ns,
+                   struct spdk_nvme_qpair *qpair,
+                   struct ioworker_args* args,
+                   struct ioworker_rets* rets)
+{
+  int ret;
+  struct ioworker_global_ctx gctx;
+
+  ret = ioworker_start(&gctx, ns, qpair, args, rets);
+  if (ret != 0)
+  {
+    return ret;
+  }
+
+  do
+  {
+    ret = ioworker_poll(&gctx, 0);
+  } while (ret > 0);
+
+  return ioworker_stop(&gctx, ret);
+}
+
+// poll qpairs of many ioworkers in one thread, at most budget completions
+// of each qpair in a round, so a busy qpair does not starve others
+int ioworker_reactor(unsigned int count,
+                     struct spdk_nvme_ns** ns,
+                     struct spdk_nvme_qpair** qpairs,
+                     struct ioworker_args* args,
+                     struct ioworker_rets* rets,
+                     int* errors,
+                     unsigned int budget)
+{
+  int ret = 0;
+  unsigned int running = 0;
+  bool* active = calloc(count, sizeof(bool));
+  struct ioworker_global_ctx* gctx = calloc(count, sizeof(struct ioworker_global_ctx));
+
+  assert(count != 0);
+  assert(active != NULL && gctx != NULL);
+
+  for (unsigned int i=0; i<count; i++)
+  {
+    errors[i] = ioworker_start(&gctx[i], ns[i], qpairs[i], &args[i], &rets[i]);
+    if (errors[i] == 0)
+    {
+      active[i] = true;
+      running ++;
+    }
+  }
+
+  while (running != 0)
+  {
+    for (unsigned int i=0; i<count; i++)
+    {
+      int r;
+
+      if (active[i] == false)
+      {
+        continue;
+      }
+
+      r = ioworker_poll(&gctx[i], budget);
+      if (r <= 0)
+      {
+        errors[i] = ioworker_stop(&gctx[i], r);
+        active[i] = false;
+        running --;
+      }
+    }
+  }
+
+  // the first error of workers
+  for (unsigned int i=0; i<count && ret == 0; i++)
+  {
+    ret = errors[i];
+  }
+
+  free(gctx);
+  free(active);
+  return ret;
+}
+
+ioworker_output* ioworker_output_init(char* name, unsigned int seconds)
+{
+  ioworker_output* out;
+  size_t size = sizeof(ioworker_output) + seconds*sizeof(uint32_t);
+
+  // main process owns the output data
+  assert(spdk_process_is_primary());
+  out = spdk_memzone_reserve(name, size, 0, 0);
+  if (out == NULL)
+  {
+    SPDK_ERRLOG("fail to reserve ioworker output %s\n", name);
+    return NULL;
+  }
+
+  memset(out, 0, size);
+  out->seconds = seconds;
+  return out;
+}
+
+ioworker_output* ioworker_output_find(char* name)
+{
+  return spdk_memzone_lookup(name);
+}
+
+void ioworker_output_fini(char* name)
+{
+  spdk_memzone_free(name);
+}
+
+// ioworker progress is published by ioworker's process, and read by
+// the main process without lock
 
 void* ioworker_progress_init(char* name)
 {
-  //create shared memzone to hold the progress data, return the name
-  return NULL;
+  struct ioworker_progress_block* p;
+
+  //create shared memzone to hold the progress data
+  assert(spdk_process_is_primary());
+  p = spdk_memzone_reserve(name, sizeof(struct ioworker_progress_block), 0, 0);
+  if (p == NULL)
+  {
+    SPDK_ERRLOG("fail to reserve ioworker progress %s\n", name);
+    return NULL;
+  }
+
+  memset(p, 0, sizeof(struct ioworker_progress_block));
+  return p;
 }
 
 void* ioworker_progress_find(char* name)
 {
   //find the progress data in shared memory, return the address
-  return NULL;
+  return spdk_memzone_lookup(name);
 }
 
 void ioworker_progress_fini(char* name)
 {
   //release the shared data
+  spdk_memzone_free(name);
+}
+
+void ioworker_progress_read(void* progress, ioworker_progress* snapshot)
+{
+  uint32_t seq;
+  struct ioworker_progress_block* p = progress;
+
+  // reader side of the seqlock, retry when the ioworker is updating
+  do
+  {
+    while ((seq = __atomic_load_n(&p->seq, __ATOMIC_ACQUIRE)) & 1);
+    memcpy(snapshot, &p->data, sizeof(ioworker_progress));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  } while (seq != __atomic_load_n(&p->seq, __ATOMIC_RELAXED));
 }
 
 
@@ -1349,14 +3930,14 @@ void log_cmd_dump(struct spdk_nvme_qpair* qpair, size_t count)
     struct tm* time;
 
     //cmd part
-    tv = log_table->table[i].time_cmd;
+    ticks_to_timeval(log_table->table[i].time_cmd, &tv);
     time = localtime(&tv.tv_sec);
     strftime(tmbuf, sizeof(tmbuf), "%Y-%m-%d %H:%M:%S", time);
     SPDK_NOTICELOG("index %d, %s.%06ld\n", i, tmbuf, tv.tv_usec);
     nvme_qpair_print_command(qpair, &log_table->table[i].cmd);
 
     //cpl part
-    tv = log_table->table[i].time_cpl;
+    ticks_to_timeval(log_table->table[i].time_cpl, &tv);
     time = localtime(&tv.tv_sec);
     strftime(tmbuf, sizeof(tmbuf), "%Y-%m-%d %H:%M:%S", time);
     SPDK_NOTICELOG("index %d, %s.%06ld\n", i, tmbuf, tv.tv_usec);
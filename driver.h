@@ -39,12 +39,153 @@ typedef struct spdk_pci_device pcie;
 typedef struct spdk_nvme_cpl cpl;
 
 
+// log-linear latency histogram, in nanoseconds. Buckets are 1ns below
+// 2^IOWORKER_LATENCY_SUB_BITS, and then each power-of-two range is split
+// into 2^IOWORKER_LATENCY_SUB_BITS buckets, so the relative error of a
+// bucket is less than 1/2^IOWORKER_LATENCY_SUB_BITS. Latency longer than
+// 2^IOWORKER_LATENCY_MAX_BITS ns (about 18 minutes) is in the last bucket.
+#define IOWORKER_LATENCY_SUB_BITS  (5)
+#define IOWORKER_LATENCY_MAX_BITS  (40)
+#define IOWORKER_LATENCY_BUCKETS   ((IOWORKER_LATENCY_MAX_BITS-IOWORKER_LATENCY_SUB_BITS+1) << IOWORKER_LATENCY_SUB_BITS)
+
+typedef struct ioworker_latency
+{
+  unsigned long count;
+  unsigned long min_ns;
+  unsigned long max_ns;
+  unsigned long sum_ns;
+  double sum_sq_ns;
+  unsigned long bucket[IOWORKER_LATENCY_BUCKETS];
+} ioworker_latency;
+
+// one phase of the workload schedule, and its statistics
+#define IOWORKER_PHASE_MAX         (64)
+
+typedef struct ioworker_phase
+{
+  unsigned int mseconds;
+  unsigned int iops;
+  unsigned short read_percentage;
+  unsigned int qdepth;
+  unsigned long io_count_read;
+  unsigned long io_count_write;
+  unsigned long latency_sum_ns;
+  unsigned long latency_max_ns;
+} ioworker_phase;
+
+// statistics of the DMA buffer pool in the process
+typedef struct buffer_pool_stats
+{
+  unsigned long hit;
+  unsigned long miss;
+  unsigned long recycle;
+  unsigned long release;
+  unsigned long cached_bytes;
+} buffer_pool_stats;
+
+// distribution of starting LBA, the value of lba_random
+#define IOWORKER_LBA_SEQUENTIAL    (0)
+#define IOWORKER_LBA_UNIFORM       (1)
+#define IOWORKER_LBA_ZIPF          (2)
+#define IOWORKER_LBA_PARETO        (3)
+#define IOWORKER_LBA_HOTCOLD       (4)
+#define IOWORKER_LBA_GAUSSIAN      (5)
+
+// one entry of the weighted io size table, and its statistics
+#define IOWORKER_SIZE_MAX          (16)
+
+typedef struct ioworker_size
+{
+  unsigned short lba_size;
+  unsigned short lba_align;
+  unsigned int weight;
+  unsigned long io_count;
+  unsigned long io_bytes;
+  unsigned long latency_sum_ns;
+  unsigned long latency_max_ns;
+} ioworker_size;
+
+// one entry of the op mix table, and its statistics
+#define IOWORKER_OP_READ           (0)
+#define IOWORKER_OP_WRITE          (1)
+#define IOWORKER_OP_TRIM           (2)
+#define IOWORKER_OP_WRITE_ZEROES   (3)
+#define IOWORKER_OP_FLUSH          (4)
+#define IOWORKER_OP_COMPARE        (5)
+#define IOWORKER_OP_MAX            (6)
+
+typedef struct ioworker_op
+{
+  unsigned int weight;
+  unsigned long io_count;
+  unsigned long error_count;
+  unsigned long latency_sum_ns;
+  unsigned long latency_max_ns;
+} ioworker_op;
+
+// one sequential stream of the ioworker, in its own LBA region
+#define IOWORKER_STREAM_MAX        (64)
+
+typedef struct ioworker_stream
+{
+  unsigned long region_start;
+  unsigned long region_end;
+  unsigned int weight;
+  unsigned long lba;
+  unsigned long io_count;
+} ioworker_stream;
+
+// output data of ioworker is kept in shared memory, which is created
+// by the main process, and filled by the ioworker process directly
+#define IOWORKER_PERCENTILE_MAX    (32)
+
+typedef struct ioworker_output
+{
+  ioworker_latency latency_read;
+  ioworker_latency latency_write;
+  unsigned int percentile_count;
+  double percentiles[IOWORKER_PERCENTILE_MAX];
+  unsigned long percentile_latency_ns[IOWORKER_PERCENTILE_MAX];
+  unsigned int phase_count;
+  unsigned int phase_once;
+  ioworker_phase phases[IOWORKER_PHASE_MAX];
+  unsigned int size_count;
+  ioworker_size sizes[IOWORKER_SIZE_MAX];
+  unsigned int stream_count;
+  ioworker_stream streams[IOWORKER_STREAM_MAX];
+  ioworker_op ops[IOWORKER_OP_MAX];
+  unsigned int seconds;
+  unsigned int io_counter_per_second[];
+} ioworker_output;
+
+// telemetry of a running ioworker, published in shared memory
+typedef struct ioworker_progress
+{
+  unsigned int mseconds;
+  unsigned int iops;
+  unsigned int iops_read;
+  unsigned int iops_write;
+  unsigned long bandwidth;
+  unsigned long io_count_read;
+  unsigned long io_count_write;
+  unsigned long latency_p50_ns;
+  unsigned long latency_p99_ns;
+  unsigned long latency_max_ns;
+  unsigned short error;
+  unsigned char finished;
+} ioworker_progress;
+
 typedef struct ioworker_args
 {
   unsigned long lba_start;
   unsigned short lba_size;
   unsigned short lba_align;
   int lba_random;
+  double lba_theta;
+  double lba_hot_fraction;
+  double lba_hot_probability;
+  double lba_center;
+  double lba_sigma;
   unsigned long region_start;
   unsigned long region_end;
   unsigned short read_percentage;
@@ -53,8 +194,24 @@ typedef struct ioworker_args
   unsigned int seconds;
   unsigned int qdepth;
   unsigned int* io_counter_per_second;
-  unsigned int* io_counter_per_latency;
+  ioworker_latency* latency_read;
+  ioworker_latency* latency_write;
+  double* percentiles;
+  unsigned long* percentile_latency_ns;
+  unsigned int percentile_count;
   unsigned int wid;
+  unsigned int verify_threads;
+  void* progress;
+  unsigned int progress_interval_ms;
+  ioworker_phase* phases;
+  unsigned int phase_count;
+  unsigned int phase_once;
+  ioworker_size* sizes;
+  unsigned int size_count;
+  ioworker_stream* streams;
+  unsigned int stream_count;
+  ioworker_op* ops;
+  unsigned long seed;
 } ioworker_args;
 
 typedef struct ioworker_rets
@@ -63,7 +220,16 @@ typedef struct ioworker_rets
   unsigned long io_count_write;
   unsigned int mseconds;
   unsigned int latency_max_us;  
+  unsigned long latency_average_ns;
+  unsigned long latency_stddev_ns;
+  unsigned long latency_read_average_ns;
+  unsigned long latency_write_average_ns;
+  unsigned long seed;
+  int core;
+  int numa_node;
+  int device_numa_node;
   unsigned short error;
+  ioworker_op ops[IOWORKER_OP_MAX];
 } ioworker_rets;
   
 typedef struct ioworker_status
@@ -72,7 +238,7 @@ typedef struct ioworker_status
   unsigned long io_count_cplt;
 } ioworker_status;
   
-extern int driver_init(void);
+extern int driver_init(int core);
 extern int driver_probe(void);
 extern int driver_fini(void);
 
@@ -95,11 +261,34 @@ extern int nvme_get_reg32(struct spdk_nvme_ctrlr* ctrlr,
                           unsigned int* value);
 
 extern int nvme_wait_completion_admin(struct spdk_nvme_ctrlr* c);
+extern int nvme_wait_completion_admin_timed(struct spdk_nvme_ctrlr* c,
+                                            uint32_t expected,
+                                            uint32_t usec);
 extern void nvme_cmd_cb_print_cpl(void* qpair, const struct spdk_nvme_cpl* cpl);
 
 
 typedef void (*cmd_cb_func)(void* cb_arg,
                                  const struct spdk_nvme_cpl* cpl);
+
+// completions collected in one poll, instead of calling cb_fn one by one
+typedef struct cpl_batch_entry
+{
+  uint16_t cid;
+  uint16_t status;
+  uint32_t cdw0;
+  uint32_t latency;
+} cpl_batch_entry;
+
+typedef struct cpl_batch
+{
+  cmd_cb_func cb_fn;
+  cpl_batch_entry* entries;
+  uint32_t size;
+  uint32_t count;
+} cpl_batch;
+
+extern int nvme_wait_completion_admin_batch(struct spdk_nvme_ctrlr* c,
+                                            cpl_batch* batch);
 extern int nvme_send_cmd_raw(struct spdk_nvme_ctrlr* ctrlr,
                              struct spdk_nvme_qpair *qpair,
                              unsigned int opcode,
@@ -129,15 +318,25 @@ extern void nvme_register_timeout_cb(struct spdk_nvme_ctrlr* ctrlr,
                                      unsigned int timeout);
 
 extern void* buffer_init(size_t bytes, uint64_t *phys_addr);
-extern void buffer_fini(void* buf);
+extern void buffer_fini(void* buf, size_t bytes, uint64_t phys_addr);
+extern void buffer_pool_get_stats(buffer_pool_stats* stats);
+extern void buffer_pool_fini(void);
+extern uint64_t crc32c_benchmark(void* buf, size_t len,
+                                unsigned int loops, int vectorized);
 
 extern qpair* qpair_create(struct spdk_nvme_ctrlr *c,
                            int prio, int depth);
 extern int qpair_wait_completion(struct spdk_nvme_qpair *q, uint32_t max_completions);
+extern int qpair_wait_completion_timed(struct spdk_nvme_qpair *q,
+                                       uint32_t expected,
+                                       uint32_t usec);
+extern int qpair_wait_completion_batch(struct spdk_nvme_qpair *q,
+                                       uint32_t max_completions,
+                                       cpl_batch* batch);
 extern int qpair_get_id(struct spdk_nvme_qpair* q);
 extern int qpair_free(struct spdk_nvme_qpair* q);
     
-extern namespace* ns_init(ctrlr* c, unsigned int nsid);
+extern namespace* ns_init(ctrlr* c, unsigned int nsid, unsigned int crc_width);
 extern int ns_cmd_read_write(int is_read, 
                              struct spdk_nvme_ns* ns,
                              struct spdk_nvme_qpair *qpair,
@@ -148,20 +347,54 @@ extern int ns_cmd_read_write(int is_read,
                              uint32_t io_flags,
                              cmd_cb_func cb_fn,
                              void* cb_arg);
+extern int ns_cmd_batch(struct spdk_nvme_ns* ns,
+                        struct spdk_nvme_qpair* qpair,
+                        void* buf,
+                        size_t len,
+                        uint32_t count,
+                        const uint8_t* ops,
+                        const uint64_t* lbas,
+                        const uint16_t* lba_counts,
+                        const uint64_t* offsets,
+                        uint32_t qdepth,
+                        uint32_t timeout,
+                        uint16_t* status,
+                        uint32_t* latency);
+extern uint32_t ns_cmd_batch_orphans(void);
 extern uint32_t ns_get_sector_size(namespace* ns);
 extern uint64_t ns_get_num_sectors(namespace* ns);
 extern int ns_fini(struct spdk_nvme_ns* ns);
 
 extern void crc32_clear(uint64_t lba, uint64_t lba_count, int sanitize, int uncorr);
+extern int crc32_save(const char* path, const char* serial,
+                      unsigned int nsid, unsigned int lbaf);
+extern int crc32_load(const char* path, const char* serial,
+                      unsigned int nsid, unsigned int lbaf);
 
 extern struct ioworker_status ioworker_get_status(unsigned int wid);
 extern int ioworker_entry(struct spdk_nvme_ns* ns,
                           struct spdk_nvme_qpair *qpair,
                           ioworker_args* args,
                           ioworker_rets* rets);
+extern int ioworker_reactor(unsigned int count,
+                            struct spdk_nvme_ns** ns,
+                            struct spdk_nvme_qpair** qpairs,
+                            ioworker_args* args,
+                            ioworker_rets* rets,
+                            int* errors,
+                            unsigned int budget);
+extern void ioworker_latency_merge(ioworker_latency* dst,
+                                  const ioworker_latency* src);
+extern unsigned long ioworker_latency_percentile(const ioworker_latency* h,
+                                                 double percentile);
+extern unsigned long ioworker_latency_bucket_ns(unsigned int index);
+extern ioworker_output* ioworker_output_init(char* name, unsigned int seconds);
+extern ioworker_output* ioworker_output_find(char* name);
+extern void ioworker_output_fini(char* name);
 extern void* ioworker_progress_init(char* name);
 extern void* ioworker_progress_find(char* name);
 extern void ioworker_progress_fini(char* name);
+extern void ioworker_progress_read(void* progress, ioworker_progress* snapshot);
 
 extern void log_buf_dump(const char* header, const void* buf, size_t len);
 extern void log_cmd_dump(struct spdk_nvme_qpair* qpair, size_t count);
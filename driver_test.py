@@ -35,10 +35,15 @@
 
 
 import os
+import math
 import time
+import array
+import random
+import struct
 import pytest
 import logging
 import warnings
+import threading
 
 import nvme as d
 import nvme  # test double import
@@ -441,6 +446,101 @@ def test_dsm_deallocate_one_tu(nvme0, nvme0n1):
     assert buf[0] == 0 or buf[0] == orig_data
 
 
+def test_dsm_deallocate_large_range(nvme0, nvme0n1):
+    buf = d.Buffer(4096)
+    q = d.Qpair(nvme0, 8)
+
+    logging.info("write data across crc table pages")
+    for lba in (0, 1024, 4096, 100000):
+        nvme0n1.write(q, buf, lba, 8).waitdone()
+
+    logging.info("trim partial and whole table pages, and read")
+    buf.set_dsm_range(0, 4, 200000)
+    nvme0n1.dsm(q, buf, 1).waitdone()
+    for lba in (0, 1024, 4096, 100000):
+        nvme0n1.read(q, buf, lba, 8).waitdone()
+
+    logging.info("write again and verify")
+    for lba in (0, 1024, 4096, 100000):
+        nvme0n1.write(q, buf, lba, 8).waitdone()
+        nvme0n1.read(q, buf, lba, 8).waitdone()
+        assert buf.data(7, 0) == lba
+
+
+def test_namespace_batch(nvme0, nvme0n1):
+    count = 1000
+    buf = d.Buffer(count*4096)
+    q = d.Qpair(nvme0, 64)
+
+    logging.info("write and read back 1000 random lba in batch")
+    lbas = array.array('Q', (random.randrange(0, 1000000)*8 for i in range(count)))
+    offsets = array.array('Q', range(0, count*4096, 4096))
+    r = nvme0n1.batch(q, buf, [1]*count, lbas, [8]*count, offsets, qdepth=32)
+    assert r.error == 0
+    assert len(r.status) == count and len(r.latency) == count
+    r = nvme0n1.batch(q, buf, bytes(count), lbas, [8]*count, offsets)
+    assert r.error == 0
+    assert max(r.status) == 0
+    assert buf.data(7, 0) == lbas[0]
+
+    logging.info("data of IO are back to back by default")
+    r = nvme0n1.batch(q, buf, bytes(count), lbas, [8]*count)
+    assert r.error == 0
+    assert buf.data(4096*(count-1)+7, 4096*(count-1)) == lbas[count-1]
+
+    logging.info("trim, read and flush in one batch")
+    r = nvme0n1.batch(q, buf, [2, 0, 4], [0, 0, 0], [8, 8, 0])
+    assert r.error == 0
+
+    logging.info("invalid command")
+    with pytest.raises(SystemError):
+        nvme0n1.batch(q, buf, [6], [0], [1])
+    with pytest.raises(SystemError):
+        nvme0n1.batch(q, buf, [0], [0], [8], [count*4096])
+
+
+def test_format_and_rewrite(nvme0, nvme0n1):
+    buf = d.Buffer(4096)
+    q = d.Qpair(nvme0, 8)
+    lbas = (0, 100000, nvme0n1.id_data(7, 0)-8)
+
+    logging.info("format invalidates crc of all written data")
+    for lba in lbas:
+        nvme0n1.write(q, buf, lba, 8).waitdone()
+    nvme0.format(nvme0n1.get_lba_format(512, 0)).waitdone()
+    for lba in lbas:
+        nvme0n1.read(q, buf, lba, 8).waitdone()
+
+    logging.info("crc is valid again after rewrite")
+    for lba in lbas:
+        nvme0n1.write(q, buf, lba, 8).waitdone()
+        nvme0n1.read(q, buf, lba, 8).waitdone()
+        assert buf.data(7, 0) == lba
+
+
+def test_crc32_save_and_load(nvme0, nvme0n1, tmpdir):
+    buf = d.Buffer(4096)
+    q = d.Qpair(nvme0, 8)
+    filename = str(tmpdir.join("crc32.bin"))
+
+    logging.info("save crc32 table after write")
+    nvme0n1.write(q, buf, 0, 8).waitdone()
+    nvme0n1.crc32_save(filename)
+
+    logging.info("overwrite, and load the old table")
+    nvme0n1.write(q, buf, 0, 8).waitdone()
+    nvme0n1.crc32_load(filename)
+    with pytest.warns(UserWarning, match="ERROR status: 02/81"):
+        nvme0n1.read(q, buf, 0, 8).waitdone()
+
+    logging.info("data written after load is verified")
+    nvme0n1.write(q, buf, 0, 8).waitdone()
+    nvme0n1.read(q, buf, 0, 8).waitdone()
+    nvme0n1.crc32_save(filename)
+    nvme0n1.crc32_load(filename)
+    nvme0n1.read(q, buf, 0, 8).waitdone()
+
+
 @pytest.mark.parametrize("size", [4096, 10, 4096*2])
 @pytest.mark.parametrize("offset", [4096, 10, 4096*2])
 def test_firmware_download(nvme0, size, offset):
@@ -614,6 +714,69 @@ def test_buffer_set_get():
     # this is a full slice
     assert b[0:] != b"Z234567890"
 
+
+def test_buffer_protocol():
+    b = d.Buffer(1024*1024)
+    m = memoryview(b)
+    assert len(m) == 1024*1024
+    assert not m.readonly
+
+    # views share the dma memory
+    m[0] = 0x5a
+    assert b[0] == 0x5a
+    b[1] = 0xa5
+    assert m[1] == 0xa5
+
+    # fill and read back 1MB by memcpy
+    pattern = bytes(range(256))*4096
+    b[:] = pattern
+    assert bytes(b) == pattern
+    assert b[4096:8192] == pattern[4096:8192]
+    assert b[:16:4] == pattern[:16:4]
+    del m
+
+    numpy = pytest.importorskip("numpy")
+    a = numpy.frombuffer(b, dtype=numpy.uint32)
+    assert a[0] == 0x03020100
+    a = numpy.frombuffer(b, dtype=numpy.uint8)
+    a[:4] = 0
+    assert b[0:4] == b"\x00\x00\x00\x00"
+    b[0:8] = numpy.arange(2, dtype=numpy.uint32)
+    assert b.data(7, 4) == 1
+
+
+def test_buffer_pool():
+    s1 = d.buffer_pool_stats()
+    b = d.Buffer(5000)
+    b[0:4] = b"abcd"
+    del b
+
+    # the recycled buffer is zeroed
+    b = d.Buffer(8192)
+    assert b[0:4] == b"\x00\x00\x00\x00"
+    del b
+    s2 = d.buffer_pool_stats()
+    assert s2.hit >= s1.hit + 1
+    assert s2.recycle >= s1.recycle + 2
+
+    # large buffers are not cached
+    b = d.Buffer(4*1024*1024)
+    del b
+    assert d.buffer_pool_stats().release == s2.release + 1
+
+    # the process caches limited bytes of the shared heap
+    bufs = [d.Buffer(2*1024*1024) for i in range(8)]
+    del bufs
+    assert d.buffer_pool_stats().cached_bytes <= 8*1024*1024
+
+
+def test_crc32c_benchmark():
+    serial = d.crc32c_benchmark(vectorized=False)
+    vectorized = d.crc32c_benchmark()
+    logging.info("crc32c: serial %.2f GB/s, vectorized %.2f GB/s" %
+                 (serial, vectorized))
+    assert serial > 0 and vectorized > 0
+
     
 @pytest.mark.parametrize("repeat", range(2))
 def test_create_many_qpair(nvme0, repeat):
@@ -925,6 +1088,35 @@ def test_ioworker_progress(nvme0, nvme0n1):
     
     a.close()
     b.close()
+
+
+def test_ioworker_telemetry(nvme0, nvme0n1):
+    w = nvme0n1.ioworker(io_size=8, lba_align=8,
+                         lba_random=True, qdepth=16,
+                         read_percentage=70, time=5,
+                         progress_interval=200).start()
+    for i in range(8):
+        time.sleep(0.5)
+        t = w.telemetry
+        logging.info(t)
+        if not t.finished and t.mseconds > 0:
+            assert t.iops == t.iops_read + t.iops_write
+            assert t.bandwidth >= t.iops*512*8
+            assert t.latency_p50_ns <= t.latency_p99_ns <= t.latency_max_ns
+    r = w.close()
+
+    # the last telemetry is published at the end
+    t = w.telemetry
+    assert t.finished
+    assert t.io_count_read == r.io_count_read
+    assert t.io_count_write == r.io_count_write
+
+    # no shared memory is reserved for outputs not requested
+    r = nvme0n1.ioworker(io_size=8, lba_align=8,
+                         lba_random=True, read_percentage=70,
+                         time=1, progress_interval=0).start().close()
+    assert r.ops.read.io_count == r.io_count_read
+    assert r.phases == [] and r.io_sizes == [] and r.streams == []
            
     
 def test_ioworker_simplified(nvme0n1):
@@ -963,6 +1155,15 @@ def test_ioworker_output_io_per_latency(nvme0n1, nvme0):
     logging.info(r)
     output_percentile_latency[99.999] > output_percentile_latency[99.99999]
 
+    # percentiles and statistics are from log-linear histograms
+    latencies = [output_percentile_latency[k] for k in sorted(output_percentile_latency)]
+    assert latencies == sorted(latencies)
+    assert r.latency_average_ns > 0
+    assert r.latency_write_average_ns == r.latency_average_ns
+    assert r.latency_read_average_ns == 0
+    assert output_percentile_latency[50] <= r.latency_max_us+1
+    assert len(r.latency_distribution_grouped) == 100
+
     
 def test_ioworker_output_io_per_second(nvme0n1, nvme0):
     nvme0.format(nvme0n1.get_lba_format(512, 0)).waitdone()
@@ -990,6 +1191,27 @@ def test_ioworker_output_io_per_second(nvme0n1, nvme0):
     assert r.iops_consistency != 0
     
 
+def test_ioworker_output_shared_memory(nvme0n1, nvme0):
+    w = nvme0n1.ioworker(io_size=8, lba_align=8,
+                         lba_random=True, qdepth=16,
+                         read_percentage=50, time=3,
+                         output_io_per_second=[]).start()
+    r = w.close()
+
+    # output arrays are views of the shared memory filled by the ioworker
+    assert len(w.output.io_per_second) == 3
+    assert w.output.io_per_second.readonly
+    assert sum(w.output.latency_read) == r.io_count_read
+    assert sum(w.output.latency_write) == r.io_count_write
+    with pytest.raises(TypeError):
+        w.output.io_per_second[0] = 0
+
+    # views keep the shared memory after the ioworker is released
+    io_per_second = w.output.io_per_second
+    del w
+    assert sum(io_per_second) > 0
+
+
 def test_ioworker_output_io_per_second_consistency(nvme0n1, nvme0):
     w = nvme0n1.ioworker(io_size=8, lba_align=8,
                          lba_random=True, qdepth=16,
@@ -1192,6 +1414,294 @@ def test_ioworker_iops(nvme0n1):
     assert time.time()-start_time < 20
 
 
+@pytest.mark.parametrize("iops", [777, 12345, 123456])
+def test_ioworker_iops_accuracy(nvme0n1, iops):
+    r = nvme0n1.ioworker(io_size=1, lba_align=1,
+                         lba_random=True, qdepth=64,
+                         read_percentage=100,
+                         iops=iops, time=5).start().close()
+    assert r.error == 0
+    assert abs(r.io_count_read - iops*5) < iops*5//100 + 64
+
+
+def test_ioworker_phases(nvme0n1):
+    r = nvme0n1.ioworker(io_size=8, lba_align=8,
+                         lba_random=True, qdepth=32,
+                         read_percentage=100,
+                         phases=[dict(time=2, iops=1000),
+                                 dict(time=2, iops=5000, read_percentage=0),
+                                 dict(time=1, qdepth=1),
+                                 dict(time=1.5, iops=0, qdepth=32)]).start().close()
+    logging.info(r)
+    assert r.error == 0
+    assert len(r.phases) == 4
+    assert abs(r.phases[0].io_count_read - 2000) < 100
+    assert r.phases[0].io_count_write == 0
+    assert abs(r.phases[1].io_count_write - 10000) < 200
+    assert r.phases[2].io_count_write == 0
+    assert r.phases[3].io_count_read > r.phases[2].io_count_read
+    assert r.mseconds < 7000
+
+    # schedule repeats till the end
+    r = nvme0n1.ioworker(io_size=8, lba_align=8,
+                         lba_random=True, qdepth=8, time=4,
+                         read_percentage=100,
+                         phases=[dict(time=0.5, iops=100),
+                                 dict(time=0.5, iops=300)]).start().close()
+    assert abs(r.phases[0].io_count_read - 200) < 20
+    assert abs(r.phases[1].io_count_read - 600) < 40
+
+
+def test_ioworker_io_size_distribution(nvme0n1):
+    r = nvme0n1.ioworker(io_size={8: 70, 32: 20, 256: 10},
+                         lba_align={8: 8, 32: 32, 256: 64},
+                         lba_random=True, qdepth=32,
+                         read_percentage=50, time=5).start().close()
+    logging.info(r.io_sizes)
+    assert r.error == 0
+    assert len(r.io_sizes) == 3
+    io_count = r.io_count_read + r.io_count_write
+    assert sum(s.io_count for s in r.io_sizes) == io_count
+    assert abs(r.io_sizes[0].io_count - io_count*0.7) < io_count*0.05
+    assert abs(r.io_sizes[2].io_count - io_count*0.1) < io_count*0.05
+    for s in r.io_sizes:
+        assert s.io_bytes == s.io_count*s.lba_size*512
+    assert r.io_sizes[2].latency_average_ns > r.io_sizes[0].latency_average_ns
+
+    # alignments do not have to divide each other
+    r = nvme0n1.ioworker(io_size={8: 1, 12: 1}, lba_align={8: 8, 12: 12},
+                         lba_random=True, read_percentage=100,
+                         time=1).start().close()
+    assert r.error == 0
+    assert len(r.io_sizes) == 2
+
+    # a single io size with its alignment in a dict
+    r = nvme0n1.ioworker(io_size=8, lba_align={8: 16},
+                         lba_random=True, read_percentage=100,
+                         time=1).start().close()
+    assert r.error == 0
+    assert r.io_sizes[0].lba_align == 16
+
+
+def lba_tokens(nvme0, nvme0n1, lba_count):
+    # the token in the last 8 bytes is changed by every write of the LBA
+    q = d.Qpair(nvme0, 8)
+    buf = d.Buffer(256*512)
+    tokens = []
+    for lba in range(0, lba_count, 256):
+        nvme0n1.read(q, buf, lba, 256).waitdone()
+        tokens += [buf.data(i*512+511, i*512+504) for i in range(256)]
+    return tokens[:lba_count]
+
+
+@pytest.mark.parametrize("lba_random, hot, share", [
+    ({'distribution': 'zipf', 'theta': 0.99}, (0, 0.1), None),
+    ({'distribution': 'pareto', 'theta': 0.8}, (0, 0.2), None),
+    ({'distribution': 'hotcold', 'hot_fraction': 0.1, 'hot_probability': 0.9}, (0, 0.1), 0.9),
+    ({'distribution': 'gaussian', 'center': 0.5, 'sigma': 0.1}, (0.4, 0.6), None)])
+def test_ioworker_lba_distribution(nvme0, nvme0n1, lba_random, hot, share):
+    # find LBAs of a small region written by the skewed workload
+    lba_count = 10000
+    nvme0n1.ioworker(io_size=1, lba_align=1, lba_random=False,
+                     region_end=lba_count, read_percentage=0,
+                     io_count=lba_count).start().close()
+    before = lba_tokens(nvme0, nvme0n1, lba_count)
+    r = nvme0n1.ioworker(io_size=1, lba_align=1, lba_random=lba_random,
+                         region_end=lba_count, read_percentage=0,
+                         io_count=2000, seed=1).start().close()
+    assert r.error == 0
+    after = lba_tokens(nvme0, nvme0n1, lba_count)
+    written = [a != b for a, b in zip(before, after)]
+
+    # io count of each part, estimated by the LBAs left unwritten
+    start, end = int(lba_count*hot[0]), int(lba_count*hot[1])
+    hot_lba = end-start
+    cold_lba = lba_count-hot_lba
+    hot_written = sum(written[start:end])
+    cold_written = sum(written)-hot_written
+    hot_io = -hot_lba*math.log(1-hot_written/hot_lba)
+    cold_io = -cold_lba*math.log(1-cold_written/cold_lba)
+    logging.info("hot io %d, cold io %d" % (hot_io, cold_io))
+    assert hot_io/hot_lba > 3*cold_io/cold_lba
+    if share is not None:
+        assert abs(hot_io/(hot_io+cold_io) - share) < 0.03
+
+
+def test_ioworker_streams(nvme0n1):
+    r = nvme0n1.ioworker(io_size=8, lba_align=8, lba_random=False,
+                         region_end=0x100000, streams=4,
+                         read_percentage=0, io_count=4000).start().close()
+    assert r.error == 0
+    assert len(r.streams) == 4
+    for st in r.streams:
+        assert st.io_count == 1000
+        assert st.lba == st.region_start + 8*1000
+
+    r = nvme0n1.ioworker(io_size=8, lba_align=8, lba_random=False,
+                         streams=[{'region_start': 0, 'region_end': 0x100000, 'weight': 3},
+                                  {'region_start': 0x80000, 'region_end': 0x200000, 'weight': 1}],
+                         read_percentage=100, io_count=40000).start().close()
+    assert r.error == 0
+    assert abs(r.streams[0].io_count - 30000) < 1000
+    assert r.streams[0].io_count + r.streams[1].io_count == 40000
+
+
+def test_ioworker_op_mix(nvme0n1):
+    r = nvme0n1.ioworker(io_size=8, lba_align=8, lba_random=True,
+                         region_end=0x10000, read_percentage=100,
+                         op_mix={'read': 60, 'write': 30, 'trim': 8, 'flush': 2},
+                         time=2).start().close()
+    logging.info(r.ops)
+    assert r.error == 0
+    io_count = r.io_count_read + r.io_count_write
+    assert r.ops.read.io_count == r.io_count_read
+    assert sum(op.io_count for op in r.ops.values()) == io_count
+    assert abs(r.ops.trim.io_count - io_count*0.08) < io_count*0.02
+    assert r.ops.flush.io_count > 0
+    assert r.ops.write_zeroes.io_count == 0
+    assert r.ops.compare.io_count == 0
+    assert r.ops.trim.latency_average_ns > 0
+
+
+def test_ioworker_core(pciaddr, nvme0n1):
+    # cores are allocated to ioworkers without collision, and on the
+    # device's NUMA node when it has enough free cores
+    local = set(d._numa_cores(pciaddr.encode('utf-8'))) - os.sched_getaffinity(0)
+    workers = [nvme0n1.ioworker(io_size=8, lba_align=8, lba_random=True,
+                                read_percentage=100, time=1).start()
+               for i in range(max(1, min(4, len(local))))]
+    rets = [w.close() for w in workers]
+    cores = [r.core for r in rets]
+    assert len(set(cores)) == len(cores)
+    for r in rets:
+        logging.info("core %d, numa node %d, device numa node %d" %
+                     (r.core, r.numa_node, r.device_numa_node))
+        if local:
+            assert r.numa_node == r.device_numa_node or r.device_numa_node < 0
+
+    # pinned to the given core
+    r = nvme0n1.ioworker(io_size=8, lba_align=8, lba_random=True,
+                         read_percentage=100, time=1, core=0).start().close()
+    assert r.core == 0
+
+
+def test_ioworker_pool(nvme0n1):
+    with d.IOWorkerPool(nvme0n1, 2, qdepth=64) as pool:
+        # the first ioworker in the pool does not wait for initialization
+        start = time.time()
+        r = nvme0n1.ioworker(io_size=8, lba_align=8, lba_random=True,
+                             read_percentage=100, io_count=1000,
+                             qdepth=16, pool=pool).start().close()
+        assert time.time()-start < 2
+        assert r.error == 0
+        assert r.io_count_read == 1000
+
+        # run many short ioworkers on the same processes
+        for i in range(20):
+            w1 = nvme0n1.ioworker(io_size=8, lba_align=8, lba_random=True,
+                                  read_percentage=50, io_count=100,
+                                  qdepth=8, pool=pool).start()
+            w2 = nvme0n1.ioworker(io_size=8, lba_align=8, lba_random=False,
+                                  read_percentage=0, io_count=100,
+                                  qdepth=8, pool=pool).start()
+            assert w1.close().error == 0
+            assert w2.close().io_count_write == 100
+
+
+def test_reactor(nvme0n1):
+    # 8 ioworkers polled by one process
+    workers = [nvme0n1.ioworker(io_size=8, lba_align=8, lba_random=True,
+                                region_start=i*0x10000, region_end=(i+1)*0x10000,
+                                read_percentage=50, qdepth=16, time=2)
+               for i in range(8)]
+    rets = d.Reactor(workers, budget=4).start().close()
+    assert len(rets) == 8
+    for r in rets:
+        assert r.error == 0
+        assert r.io_count_read > 0
+        assert r.io_count_write > 0
+
+    with d.Reactor([nvme0n1.ioworker(io_size=8, lba_align=8, lba_random=False,
+                                     read_percentage=100, qdepth=4, io_count=1000)
+                    for i in range(4)]):
+        pass
+
+
+def test_ioworker_thread(nvme0, nvme0n1):
+    ticks = 0
+    def counter():
+        nonlocal ticks
+        while not done:
+            ticks += 1
+            time.sleep(0.001)
+
+    # the ioworker thread and python threads run together in this process
+    done = False
+    t = threading.Thread(target=counter)
+    t.start()
+    r = nvme0n1.ioworker(io_size=8, lba_align=8, lba_random=True,
+                         read_percentage=50, qdepth=16, time=2,
+                         thread=True).start().close()
+    assert r.error == 0
+    assert r.io_count_read > 0
+    assert r.io_count_write > 0
+    assert ticks > 100
+
+    # waitdone does not block other threads
+    ticks = 0
+    buf = d.Buffer(4096)
+    q = d.Qpair(nvme0, 16)
+    for i in range(1000):
+        nvme0n1.read(q, buf, i, 1).waitdone()
+    nvme0.getfeatures(7).waitdone()
+    done = True
+    t.join()
+    assert ticks > 0
+
+    with pytest.raises(AssertionError):
+        nvme0n1.ioworker(io_size=8, lba_align=8, lba_random=True,
+                         read_percentage=50, io_count=100,
+                         thread=True, core=0)
+
+
+def test_waitdone_threads(nvme0, nvme0n1):
+    errors = []
+    def getfeatures_loop():
+        try:
+            for i in range(1000):
+                nvme0.getfeatures(7).waitdone()
+        except Exception as e:
+            errors.append(e)
+
+    # threads wait their own admin commands in the same admin queue
+    threads = [threading.Thread(target=getfeatures_loop) for i in range(4)]
+    [t.start() for t in threads]
+    [t.join() for t in threads]
+    assert not errors
+
+
+def test_ioworker_seed(nvme0n1):
+    def run(seed):
+        return nvme0n1.ioworker(io_size={8: 50, 16: 30, 64: 20}, lba_align=8,
+                                lba_random=True, read_percentage=50,
+                                io_count=10000, qdepth=8, seed=seed).start().close()
+
+    r1 = run(0x1234_5678_9abc_def0)
+    r2 = run(0x1234_5678_9abc_def0)
+    r3 = run(1)
+    assert r1.seed == r2.seed == 0x1234_5678_9abc_def0
+    assert r1.io_count_read == r2.io_count_read
+    assert [s.io_count for s in r1.io_sizes] == [s.io_count for s in r2.io_sizes]
+    assert [s.io_count for s in r1.io_sizes] != [s.io_count for s in r3.io_sizes]
+
+    # workers get different seeds by default
+    w1 = nvme0n1.ioworker(io_size=8, lba_align=8, lba_random=True,
+                          read_percentage=100, time=1).start()
+    w2 = nvme0n1.ioworker(io_size=8, lba_align=8, lba_random=True,
+                          read_percentage=100, time=1).start()
+    assert w1.close().seed != w2.close().seed
+
+
 def test_ioworker_time(nvme0n1):
     import time
     start_time = time.time()
@@ -1283,6 +1793,27 @@ def test_ioworker_write_read_verify(nvme0n1):
         print(w.close())
 
 
+@pytest.mark.parametrize("verify_threads", [1, 2, 8])
+def test_ioworker_verify_threads(nvme0n1, verify_threads):
+    w = nvme0n1.ioworker(io_size=8, lba_align=8, lba_random=False,
+                         region_end=100000, read_percentage=0,
+                         io_count=100000/8, qdepth=64).start().close()
+    assert w.error == 0
+
+    r = nvme0n1.ioworker(io_size=8, lba_align=8, lba_random=True,
+                         region_end=100000, read_percentage=100,
+                         time=5, qdepth=64,
+                         verify_threads=verify_threads).start().close()
+    assert r.error == 0
+    assert r.io_count_read > 0
+
+    r = nvme0n1.ioworker(io_size=8, lba_align=8, lba_random=True,
+                         region_end=100000, read_percentage=50,
+                         time=5, qdepth=64,
+                         verify_threads=verify_threads).start().close()
+    assert r.error == 0
+
+
 def admin_work(args, nvme0):
     print(os.getpid(), args)
     nvme0.getfeatures(0x7).waitdone()
@@ -1319,6 +1850,36 @@ def test_waitdone_nothing(nvme0, nvme0n1):
     qpair.waitdone(0)
 
 
+def test_waitdone_batch(nvme0, nvme0n1):
+    buf = d.Buffer(4096)
+    q = d.Qpair(nvme0, 100)
+    cids = []
+
+    def cmd_cb_not_called(cdw0, status):
+        assert False
+
+    def io_batch_cb(cpls):
+        for cid, status, cdw0, latency in struct.iter_unpack("HHII", cpls.cast('B')):
+            assert status>>1 == 0
+            cids.append(cid)
+
+    # all completions are passed to the batch callback
+    for i in range(64):
+        nvme0n1.read(q, buf, i, 1, cb=cmd_cb_not_called)
+    q.waitdone(64, batch=io_batch_cb)
+    assert len(cids) == 64
+    assert len(set(cids)) == 64
+
+    # structured array of completions
+    numpy = pytest.importorskip("numpy")
+    orig_config = 0
+    def admin_batch_cb(cpls):
+        nonlocal orig_config; orig_config = numpy.asarray(cpls)['cdw0'][0]
+    nvme0.getfeatures(7).waitdone(batch=admin_batch_cb)
+    nvme0.getfeatures(7, cb=cmd_cb_not_called).waitdone(batch=admin_batch_cb)
+    assert orig_config != 0
+
+
 @pytest.mark.parametrize("repeat", range(10))
 def test_ioworkers_with_pattern(nvme0n1, nvme0, repeat):
     with nvme0n1.ioworker(lba_start=0, io_size=8, lba_align=64,
@@ -1504,10 +2065,15 @@ def test_buffer_token_single_process(nvme0, nvme0n1):
                           qprio=0, qdepth=9):
         pass
 
+    # ioworker leases its tokens after this process
+    nvme0n1.read(io_qpair, b, 0, 1).waitdone()
+    token_worker = b.data(507, 504)
+
     nvme0n1.write(io_qpair, b, 1, 1).waitdone()
     nvme0n1.read(io_qpair, b, 1, 1).waitdone()
     token_end = b.data(507, 504)
-    assert token_end-token_begin == 8*100+1
+    assert token_end-token_begin == 1
+    assert token_worker > token_end
 
     
 def test_buffer_token_multi_processes(nvme0, nvme0n1):
@@ -1532,10 +2098,15 @@ def test_buffer_token_multi_processes(nvme0, nvme0n1):
                          qprio=0, qdepth=9):
         pass
 
+    # ioworker leases its tokens after this process
+    nvme0n1.read(io_qpair, b, 0, 1).waitdone()
+    token_worker = b.data(507, 504)
+
     nvme0n1.write(io_qpair, b, 1, 1).waitdone()
     nvme0n1.read(io_qpair, b, 1, 1).waitdone()
     token_end = b.data(507, 504)
-    assert token_end-token_begin == 8*128*2+1
+    assert token_end-token_begin == 1
+    assert token_worker > token_end
 
 
 def test_buffer_token_single_small_process(nvme0, nvme0n1):
@@ -1554,10 +2125,15 @@ def test_buffer_token_single_small_process(nvme0, nvme0n1):
                           qprio=0, qdepth=9):
         pass
 
+    # ioworker leases its tokens after this process
+    nvme0n1.read(io_qpair, b, 0, 1).waitdone()
+    token_worker = b.data(507, 504)
+
     nvme0n1.write(io_qpair, b, 100, 1).waitdone()
     nvme0n1.read(io_qpair, b, 100, 1).waitdone()
     token_end = b.data(507, 504)
-    assert token_end-token_begin == 8*1+1
+    assert token_end-token_begin == 1
+    assert token_worker > token_end
 
 
 def test_buffer_token_single_large_process(nvme0, nvme0n1):
@@ -1576,10 +2152,15 @@ def test_buffer_token_single_large_process(nvme0, nvme0n1):
                           qprio=0, qdepth=9):
         pass
 
-    nvme0n1.write(io_qpair, b, 0, 1).waitdone()
+    # ioworker leases its tokens after this process
     nvme0n1.read(io_qpair, b, 0, 1).waitdone()
+    token_worker = b.data(507, 504)
+
+    nvme0n1.write(io_qpair, b, 1, 1).waitdone()
+    nvme0n1.read(io_qpair, b, 1, 1).waitdone()
     token_end = b.data(507, 504)
-    assert token_end-token_begin == 8*1000+1
+    assert token_end-token_begin == 1
+    assert token_worker > token_end
 
 
 def test_command_supported_and_effect(nvme0, nvme0n1):
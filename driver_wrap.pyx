@@ -187,7 +187,7 @@ make test
 Features
 ========
 
-Pynvme writes and reads data in buffer to NVMe device LBA space. In order to verify the data integrity, it injects LBA address and version information into the write data buffer, and check with them after read completion. Furthermore, Pynvme computes and verifies CRC32 of each LBA on the fly. Both data buffer and LBA CRC32 are stored in host memory, so ECC memory are recommended if you are considering serious tests.
+Pynvme writes and reads data in buffer to NVMe device LBA space. In order to verify the data integrity, it injects LBA address and version information into the write data buffer, and check with them after read completion. Furthermore, Pynvme computes and verifies CRC32 of each LBA on the fly. Both data buffer and LBA CRC32 are stored in host memory, so ECC memory are recommended if you are considering serious tests. The LBA CRC32 table is kept in shared memory, and its pages are populated only when the LBAs are written. The CRC32 can be folded to 16 or 8 bits by crc_width of Namespace, to save host memory on large namespace.
 
 Buffer should be allocated for data commands, and held till that command is completed because the buffer is being used by NVMe device. Users need to pay more attention on the life scope of the buffer in Python test scripts.
 
@@ -236,12 +236,16 @@ Pynvme is focused on mainstream client NVMe SSD, following NVMe spec v1.3c. Some
 import os
 import sys
 import time
+import array
 import atexit
+import queue
 import signal
+import math
 import struct
 import logging
 import warnings
 import statistics
+import threading
 import subprocess
 import multiprocessing
 
@@ -251,6 +255,7 @@ from libc.string cimport strncpy, memset, strlen
 from libc.stdio cimport printf
 from cpython.mem cimport PyMem_Malloc, PyMem_Free
 from cpython.exc cimport PyErr_CheckSignals
+from cpython.buffer cimport PyBUF_WRITABLE
 
 # c driver
 cimport cdriver as d
@@ -265,12 +270,16 @@ __version__ = "0.1.10"
 # driver times out earlier than driver wrap
 _cTIMEOUT = 5
 cdef void timeout_driver_cb(void* cb_arg, d.ctrlr* ctrlr,
-                            d.qpair * qpair, unsigned short cid):
+                            d.qpair * qpair, unsigned short cid) with gil:
     error_string = "driver timeout: %d sec, qpair: %d, cid: %d" % \
         (_cTIMEOUT, d.qpair_get_id(qpair), cid)
     warnings.warn(error_string)
 
 
+# polling without gil returns in this time to check signals, in us
+cdef unsigned int _cPOLL_us = 10000
+
+
 # timeout signal in wrap layer, it's an assert fail
 # driver wrap needs longer timeout, some commands need more time, like format
 _cTIMEOUT_wrap = 60
@@ -280,10 +289,27 @@ def _timeout_signal_handler(signum, frame):
     raise TimeoutError(error_string)
 
 
-# prevent waitdone reentry
+# prevent waitdone reentry, other threads can wait their own commands
+class _ReentryFlag(threading.local):
+    flag = False
+
+_reentry = _ReentryFlag()
+
 def _reentry_flag_init():
-    global _reentry_flag
-    _reentry_flag = False
+    _reentry.flag = False
+
+
+# only the main thread handles signals, so it owns the alarm
+def _alarm(seconds):
+    if threading.current_thread() is threading.main_thread():
+        signal.alarm(seconds)
+
+
+# other threads have no alarm, so they check the deadline in polling
+def _timeout_check(deadline):
+    if time.monotonic() > deadline:
+        _reentry_flag_init()
+        raise TimeoutError("script timeout: %d sec" % _cTIMEOUT_wrap)
 
 
 # for abrupt exit
@@ -302,7 +328,7 @@ cdef struct _cpl:
     unsigned short cid
     unsigned short status1  #this word actully inculdes some other bites
 
-cdef void cmd_cb(void* f, const d.cpl* cpl):
+cdef void cmd_cb(void* f, const d.cpl* cpl) with gil:
     arg = <_cpl*>cpl  # no qa
     status1 = arg.status1
     func = <object>f   # no qa
@@ -319,13 +345,47 @@ cdef void cmd_cb(void* f, const d.cpl* cpl):
         sct = (status1>>9) & 0x7
         warnings.warn("ERROR status: %02x/%02x" % (sct, sc))
 
-cdef void aer_cmd_cb(void* f, const d.cpl* cpl):
+cdef void aer_cmd_cb(void* f, const d.cpl* cpl) with gil:
     warnings.warn("AER notification is triggered")
     cmd_cb(f, cpl)
 
 
+# completions of one poll are passed to the callback in a batch
+cdef class _CplBatch:
+    cdef d.cpl_batch _batch
+    cdef object _func
+
+    def __cinit__(self, func, unsigned int size=256):
+        self._batch.entries = <d.cpl_batch_entry*>PyMem_Malloc(size*sizeof(d.cpl_batch_entry))
+        if not self._batch.entries:
+            raise MemoryError()
+        self._batch.size = size
+        self._batch.count = 0
+        self._batch.cb_fn = cmd_cb
+        self._func = func
+
+    def __dealloc__(self):
+        PyMem_Free(self._batch.entries)
+
+    cdef deliver(self):
+        cdef bytes data
+
+        if self._batch.count == 0:
+            return
+
+        # a copy, because entries are overwritten in the next poll
+        data = (<char*>self._batch.entries)[:self._batch.count*sizeof(d.cpl_batch_entry)]
+        cpls = _shared_array(data, <char*>data, self._batch.count,
+                             sizeof(d.cpl_batch_entry),
+                             b"T{H:cid:H:status:I:cdw0:I:latency:}")
+        try:
+            self._func(cpls)
+        except AssertionError as e:
+            warnings.warn("ASSERT: "+str(e))
+
+
 cdef class Buffer(object):
-    """Buffer class allocated in DPDK memzone,so can be used by DMA. Data in buffer is clear to 0 in initialization.
+    """Buffer class allocated in DPDK memzone,so can be used by DMA. Data in buffer is clear to 0 in initialization. Buffers upto 2MB are recycled in a pool of the process, see buffer_pool_stats(). Buffer supports the buffer protocol, so memoryview(), bytes() and numpy.frombuffer() access the DMA memory directly.
 
     Args:
         size (int): the size (in bytes) of the buffer
@@ -371,6 +431,8 @@ cdef class Buffer(object):
     cdef size_t size
     cdef char* name
     cdef unsigned long phys_addr
+    cdef Py_ssize_t _shape[1]
+    cdef Py_ssize_t _itemsize
 
     def __cinit__(self, size=4096, name="buffer"):
         assert size > 0, "0 is not valid size"
@@ -388,13 +450,15 @@ cdef class Buffer(object):
         self.ptr = d.buffer_init(size, &self.phys_addr)
         if self.ptr is NULL:
             raise MemoryError()
+        self._shape[0] = size
+        self._itemsize = 1
 
     def __dealloc__(self):
         if self.name is not NULL:
             PyMem_Free(self.name)
 
         if self.ptr is not NULL:
-            d.buffer_fini(self.ptr)
+            d.buffer_fini(self.ptr, self.size, self.phys_addr)
 
     @property
     def phys_addr(self):
@@ -442,9 +506,26 @@ cdef class Buffer(object):
     def __repr__(self):
         return '<buffer name: %s>' % str(self.name, "ascii")
 
+    def __getbuffer__(self, Py_buffer* buffer, int flags):
+        # expose the DMA memory itself, no copy
+        buffer.buf = self.ptr
+        buffer.obj = self
+        buffer.len = self.size
+        buffer.readonly = 0
+        buffer.itemsize = self._itemsize
+        buffer.format = b"B"
+        buffer.ndim = 1
+        buffer.shape = self._shape
+        buffer.strides = &self._itemsize
+        buffer.suboffsets = NULL
+        buffer.internal = NULL
+
+    def __releasebuffer__(self, Py_buffer* buffer):
+        pass
+
     def __getitem__(self, index):
         if isinstance(index, slice):
-            return bytes([self[i] for i in range(*index.indices(len(self)))])
+            return bytes(memoryview(self)[index])
         elif isinstance(index, int):
             return (<unsigned char*>self.ptr)[index]
         else:
@@ -452,9 +533,13 @@ cdef class Buffer(object):
 
     def __setitem__(self, index, value):
         if isinstance(index, slice):
+            # write all data from start, regardless of the stop and step
             start = 0 if index.start is None else index.start
-            for i, d in enumerate(value):
-                self[i+start] = d
+            if not isinstance(value, (bytes, bytearray, memoryview, Buffer)):
+                value = bytes(value)
+            value = memoryview(value).cast('B')
+            assert start >= 0 and start+len(value) <= self.size, "data exceeds the buffer"
+            memoryview(self)[start:start+len(value)] = value
         elif isinstance(index, int):
             (<unsigned char*>self.ptr)[index] = value
         else:
@@ -471,6 +556,42 @@ cdef class Buffer(object):
         self[index*16:(index+1)*16] = struct.pack("<LLQ", 0, lba_count, lba)
 
 
+def buffer_pool_stats():
+    """statistics of the DMA buffer pool in this process
+
+    Buffers upto 2MB are recycled in free lists of power-of-2 sizes, and zeroed when they are returned to the pool. The pool caches upto 8MB in each process, and frees other buffers to the memzone heap.
+
+    Rets:
+        dict of hit, miss, recycle (buffers returned to the pool), release (buffers freed to the memzone heap), and cached_bytes
+    """
+
+    cdef d.buffer_pool_stats stats
+    d.buffer_pool_get_stats(&stats)
+    return DotDict(stats)
+
+
+def crc32c_benchmark(size=128*1024, loops=10000, vectorized=True):
+    """measure the speed of LBA CRC32 calculation used in data fill and verify
+
+    Args:
+        size (int): the size (in bytes) of the buffer to calculate in each loop
+                    default: 128K
+        loops (int): the times to calculate the whole buffer
+                     default: 10000
+        vectorized (bool): True to use the kernel selected by CPU features, False to calculate LBA one by one
+                           default: True
+
+    Rets:
+        (float): GB/s on one CPU core
+    """
+
+    cdef Buffer buf = Buffer(size)
+    for i in range(0, size, 512):
+        buf[i] = i & 0xff
+    ns = d.crc32c_benchmark(buf.ptr, size, loops, vectorized)
+    return size*loops/ns
+
+
 cdef class Subsystem(object):
     """Subsystem class. Prefer to use fixture "subsystem" in test scripts.
 
@@ -797,29 +918,46 @@ cdef class Controller(object):
         self.getlogpage(5, logpage_buf).waitdone()
         return logpage_buf.data((opcode+1)*4-1, opcode*4) != 0
 
-    def waitdone(self, expected=1):
+    def waitdone(self, expected=1, batch=None):
         """sync until expected commands completion
 
         Args:
             expected (int): expected commands to complete
                             default: 1
+            batch (function): callback function called once with all completions reaped in one poll, instead of the callback of each command. See Qpair.waitdone().
+                              default: None
 
         Notices:
             Do not call this function in commands callback functions.
+            GIL is released during polling, so other threads can run. Completions of admin commands are counted for the thread which sent them, though any polling thread may reap them and call their callbacks.
         """
 
-        reaped = 0
+        cdef _CplBatch cpls = None
+        cdef unsigned int to_reap
+        cdef int reaped = 0
+        cdef int ret
+
+        assert _reentry.flag is False, f"cannot re-entry waitdone() functions which may be caused by waitdone in callback functions, {_reentry.flag}"
+        _reentry.flag = True
 
-        global _reentry_flag
-        assert _reentry_flag is False, f"cannot re-entry waitdone() functions which may be caused by waitdone in callback functions, {_reentry_flag}"
-        _reentry_flag = True
+        if batch is not None:
+            cpls = _CplBatch(batch)
 
         logging.debug("to reap %d admin commands" % expected)
         # some admin commands need long timeout limit, like: format,
-        signal.alarm(_cTIMEOUT_wrap)
+        _alarm(_cTIMEOUT_wrap)
+        deadline = time.monotonic() + _cTIMEOUT_wrap
         while reaped < expected:
-            # wait admin Q pair done
-            reaped += d.nvme_wait_completion_admin(self._ctrlr)
+            # wait admin Q pair done without gil, so other threads can run
+            to_reap = expected-reaped
+            if cpls is None:
+                with nogil:
+                    ret = d.nvme_wait_completion_admin_timed(self._ctrlr, to_reap, _cPOLL_us)
+            else:
+                with nogil:
+                    ret = d.nvme_wait_completion_admin_batch(self._ctrlr, &cpls._batch)
+                cpls.deliver()
+            reaped += ret
 
             # Since signals are delivered asynchronously at unpredictable
             # times, it is problematic to run any meaningful code directly
@@ -830,13 +968,14 @@ cdef class Controller(object):
             # handlers.
             # - from: https://stackoverflow.com/questions/16769870/cython-python-and-keyboardinterrupt-ignored
             PyErr_CheckSignals()
-        signal.alarm(0)
+            _timeout_check(deadline)
+        _alarm(0)
 
         # in admin queue, may reap more than expected, because driver
         # will get admin CQ as many as possible
         assert reaped >= expected, \
             "not reap the exact completions! reaped %d, expected %d" % (reaped, expected)
-        _reentry_flag = False
+        _reentry.flag = False
 
     def abort(self, cid, sqid=0, cb=None):
         """abort admin commands
@@ -1300,35 +1439,53 @@ cdef class Qpair(object):
 
         d.log_cmd_dump(self._qpair, count)
 
-    def waitdone(self, expected=1):
+    def waitdone(self, expected=1, batch=None):
         """sync until expected commands completion
 
         Args:
             expected (int): expected commands to complete
                             default: 1
+            batch (function): callback function called once with all completions reaped in one poll, instead of the callback of each command. The completions are in a read-only array of structure (cid, status, cdw0, latency), which the callback can keep. numpy.asarray() makes it a structured array. Status is the same as the one passed to command callbacks, and latency is in us. Errors are not warned, so the callback should check them.
+                              default: None
 
         Notices:
             Do not call this function in commands callback functions.
+            GIL is released during polling, so other threads can run. But a qpair should be used in only one thread.
         """
 
-        reaped = 0
+        cdef _CplBatch cpls = None
+        cdef unsigned int to_reap
+        cdef int reaped = 0
+        cdef int ret
+
+        assert _reentry.flag is False, f"cannot re-entry waitdone() functions which may be caused by waitdone in callback functions, {_reentry.flag}"
+        _reentry.flag = True
 
-        global _reentry_flag
-        assert _reentry_flag is False, f"cannot re-entry waitdone() functions which may be caused by waitdone in callback functions, {_reentry_flag}"
-        _reentry_flag = True
+        if batch is not None:
+            cpls = _CplBatch(batch)
 
         logging.debug("to reap %d io commands, sqid %d" % (expected, self.sqid))
-        signal.alarm(_cTIMEOUT_wrap)
+        _alarm(_cTIMEOUT_wrap)
+        deadline = time.monotonic() + _cTIMEOUT_wrap
         while reaped < expected:
-            # wait IO Q pair done, max 8 cpl in one time
-            max_to_reap = (expected-reaped) % 8
-            reaped += d.qpair_wait_completion(self._qpair, max_to_reap)
+            # wait IO Q pair done without gil, so other threads can run
+            to_reap = expected-reaped
+            if cpls is None:
+                with nogil:
+                    ret = d.qpair_wait_completion_timed(self._qpair, to_reap, _cPOLL_us)
+            else:
+                to_reap = min(to_reap, cpls._batch.size)
+                with nogil:
+                    ret = d.qpair_wait_completion_batch(self._qpair, to_reap, &cpls._batch)
+                cpls.deliver()
+            reaped += ret
             PyErr_CheckSignals()
-        signal.alarm(0)
+            _timeout_check(deadline)
+        _alarm(0)
 
         assert reaped == expected, \
             "not reap the exact completions! reaped %d, expected %d" % (reaped, expected)
-        _reentry_flag = False
+        _reentry.flag = False
 
 
 class NamespaceCreationError(Exception):
@@ -1345,6 +1502,8 @@ cdef class Namespace(object):
     Args:
         nvme (Controller): controller where to create the queue
         nsid (int): nsid of the namespace
+        crc_width (int): bits of the data checksum kept for each LBA in host memory, 32, 16 or 8. Narrower checksum costs less host memory on large namespace.
+                         default: 32
     """
 
     cdef d.namespace * _ns
@@ -1353,12 +1512,13 @@ cdef class Namespace(object):
     cdef unsigned int sector_size
     cdef Controller _nvme
 
-    def __cinit__(self, Controller nvme, unsigned int nsid=1):
+    def __cinit__(self, Controller nvme, unsigned int nsid=1, unsigned int crc_width=32):
         logging.debug("initialize namespace nsid %d" % nsid)
+        assert crc_width in (32, 16, 8), "crc width should be 32, 16 or 8"
         self._nvme = nvme
         strncpy(self._bdf, nvme._bdf, 8)
         self._nsid = nsid
-        self._ns = d.ns_init(nvme._ctrlr, nsid)
+        self._ns = d.ns_init(nvme._ctrlr, nsid, crc_width)
         if self._ns is NULL:
             raise NamespaceCreationError()
         self.sector_size = d.ns_get_sector_size(self._ns)
@@ -1447,12 +1607,53 @@ cdef class Namespace(object):
             if data_size == (1<<((format_support>>16)&0xff)) and \
                meta_size == (format_support&0xffff):
                 return fid
-    
+
+    def crc32_save(self, filename):
+        """save the LBA CRC32 table of the namespace to a file
+
+        Only written LBAs are stored, so the file is sparse. The file is bound to the controller serial number, nsid and LBA format of the namespace.
+
+        Args:
+            filename (str): the pathname of the file to save the table
+
+        Notices:
+            Do not save the table when any IO is outstanding, including ioworkers.
+        """
+
+        serial = self._nvme.id_data(23, 4, str)
+        lbaf = self.id_data(26) & 0xf
+        logging.info("save crc32 table to %s" % filename)
+        ret = d.crc32_save(filename.encode('utf-8'), serial.encode('ascii'),
+                           self._nsid, lbaf)
+        assert ret == 0, "fail to save crc32 table: %d" % ret
+
+    def crc32_load(self, filename):
+        """load the LBA CRC32 table of the namespace from a file saved by crc32_save()
+
+        The table in host memory is replaced, so data written in previous script or before power cycle can be verified again.
+
+        Args:
+            filename (str): the pathname of the file to load the table
+
+        Notices:
+            The file must be saved from the namespace with the same controller serial number, nsid and LBA format.
+        """
+
+        serial = self._nvme.id_data(23, 4, str)
+        lbaf = self.id_data(26) & 0xf
+        logging.info("load crc32 table from %s" % filename)
+        ret = d.crc32_load(filename.encode('utf-8'), serial.encode('ascii'),
+                           self._nsid, lbaf)
+        assert ret == 0, "fail to load crc32 table: %d" % ret
+
     def ioworker(self, io_size, lba_align, lba_random,
                  read_percentage, time=0, qdepth=64,
                  region_start=0, region_end=0xffff_ffff_ffff_ffff,
                  iops=0, io_count=0, lba_start=0, qprio=0,
-                 output_io_per_second=None, output_percentile_latency=None):
+                 output_io_per_second=None, output_percentile_latency=None,
+                 verify_threads=0, progress_interval=1000, phases=None,
+                 seed=0, streams=None, op_mix=None, pool=None, core=None,
+                 thread=False):
         """workers sending different read/write IO on different CPU cores.
 
         User defines IO characteristics in parameters, and then the ioworker
@@ -1466,9 +1667,13 @@ cdef class Namespace(object):
         Each ioworker can run upto 24 hours.
 
         Args:
-            io_size (short): IO size, unit is LBA
-            lba_align (short): IO alignment, unit is LBA
-            lba_random (bool): True if sending IO with random starting LBA
+            io_size (short or dict): IO size, unit is LBA. A dict of {io_size: weight} makes a mix of IO sizes, e.g. {8: 70, 32: 20, 256: 10}. Statistics of each IO size are returned in rets['io_sizes'].
+            lba_align (short or dict): IO alignment, unit is LBA. A dict of {io_size: lba_align} gives alignment of each IO size, and the region is aligned to the least common multiple of them.
+            lba_random (bool or dict): True if sending IO with random starting LBA. A dict selects a skewed distribution of the starting LBA, where hot LBAs are at the beginning of the region:
+                                       {'distribution': 'zipf', 'theta': 0.99}, zipfian with theta in (0, 1)
+                                       {'distribution': 'pareto', 'theta': 0.8}, theta of IO goes to 1-theta of the region, theta in (0.5, 1)
+                                       {'distribution': 'hotcold', 'hot_fraction': 0.1, 'hot_probability': 0.9}, IO goes to the first hot_fraction of the region by hot_probability
+                                       {'distribution': 'gaussian', 'center': 0.5, 'sigma': 0.1}, normal distribution, center and sigma are fractions of the region
             read_percentage (int): sending read/write mixed IO, 0 means write only, 100 means read only
             time (int): specified maximum seconds of the IOWorker
                         default:0, no limit (upto 24hr)
@@ -1488,26 +1693,137 @@ cdef class Namespace(object):
                          default: 0, for default Round Robin arbitration
             output_io_per_second (list): list to hold the output data of io_per_second.
                                          default: None, not to collect the data
-            output_percentile_latency (dict): dict of io counter on different percentile latency. Dict key is the percentage, and the value is the latency in ms.
+            output_percentile_latency (dict): dict of io counter on different percentile latency. Dict key is the percentage, and the value is the latency in us, with ns resolution.
                                               default: None, not to collect the data
+            verify_threads (int): threads verifying read data, so the IOWorker's core only polls the Qpair. Upto 8 threads.
+                                  default: 0, verify read data in the completion
+            progress_interval (int): milli-seconds between telemetry updates of the IOWorker, 0 to disable the telemetry.
+                                     default: 1000
+            phases (list): schedule of the workload. Each phase is a dict of time (seconds), and optional iops, read_percentage and qdepth, which default to the IOWorker's arguments. Phases are applied in order, and repeated until the IOWorker ends. Without time and io_count, the schedule runs once and the IOWorker stops at its end. Statistics of each phase are returned in rets['phases'].
+                           default: None, the workload does not change
+            seed (long): seed of the IOWorker's random generator of LBA, read/write and IO size. The same seed reproduces the same IO sequence, and the seed used is returned in rets['seed'].
+                         default: 0, seeded by the worker id, so concurrent IOWorkers send different IO
+            streams (int or list): sequential streams interleaving in the IOWorker, when lba_random is False. An int splits the region to the number of streams evenly. A list of dicts gives region_start, region_end and optional weight of each stream, and regions can overlap. Streams are sent in turn when their weights are all equal, otherwise picked randomly by weight. Upto 64 streams, and the io count of each stream is returned in rets['streams'].
+                            default: None, one sequential stream in the whole region
+            op_mix (dict): weights of IO commands sent by the IOWorker, e.g. {'read': 60, 'write': 30, 'trim': 8, 'flush': 2}. Commands are read, write, trim, write_zeroes, flush and compare. Trim and write zeroes clear the data checksum of the LBAs. Compare data is not prepared, so miscompare is counted in error_count but does not stop the IOWorker. The op mix takes place of read_percentage, including in phases. Count and latency of each command are returned in rets['ops'], and trim, write zeroes and flush are counted as write in io_count_write.
+                           default: None, read and write by read_percentage
+            pool (IOWorkerPool): run the IOWorker in a process of the pool, which is initialized already, instead of spawning a new process
+                                 default: None, spawn a process for the IOWorker
+            core (int): CPU core to run the IOWorker. The core, and NUMA nodes of the core and the device, are returned in rets. Data buffers are allocated in the memory of the device's NUMA node.
+                        default: None, a free core on the NUMA node of the device
+            thread (bool): run the IOWorker in a native thread of this process without GIL, instead of spawning a new process. It sends IO in its own qpair of this namespace.
+                           default: False
 
         Rets:
             ioworker instance
 
         Notice:
-            use ioworker.progress to get the realtime io counters
+            use ioworker.progress to get the realtime io counters, and ioworker.telemetry to get the realtime IOPS, bandwidth and latency
         """
 
-        assert not (time==0 and io_count==0), "when to stop the ioworker?"
+        # distribution of starting lba and its parameters
+        if isinstance(lba_random, dict):
+            distributions = {'uniform': d.IOWORKER_LBA_UNIFORM,
+                             'zipf': d.IOWORKER_LBA_ZIPF,
+                             'pareto': d.IOWORKER_LBA_PARETO,
+                             'hotcold': d.IOWORKER_LBA_HOTCOLD,
+                             'gaussian': d.IOWORKER_LBA_GAUSSIAN}
+            dist = lba_random.get('distribution', 'uniform')
+            assert dist in distributions, "unknown lba distribution: %s" % dist
+            lba_random = (distributions[dist],
+                          lba_random.get('theta', 0.99 if dist=='zipf' else 0.8),
+                          lba_random.get('hot_fraction', 0.2),
+                          lba_random.get('hot_probability', 0.8),
+                          lba_random.get('center', 0.5),
+                          lba_random.get('sigma', 0.1))
+            if dist == 'zipf':
+                assert 0 < lba_random[1] < 1, "zipf theta should be in (0, 1)"
+            if dist == 'pareto':
+                assert 0.5 < lba_random[1] < 1, "pareto theta should be in (0.5, 1)"
+            assert 0 < lba_random[2] <= 1, "hot_fraction should be in (0, 1]"
+            assert 0 <= lba_random[3] <= 1, "hot_probability should be in [0, 1]"
+            assert 0 <= lba_random[4] <= 1 and lba_random[5] > 0, "invalid gaussian center or sigma"
+        else:
+            lba_random = (d.IOWORKER_LBA_UNIFORM if lba_random else d.IOWORKER_LBA_SEQUENTIAL,
+                          0, 0, 0, 0, 0)
+
+        # weights of io commands
+        if op_mix is not None:
+            for name, weight in op_mix.items():
+                assert name in _IOWorker._op_names, "unknown command in op mix: %s" % name
+                assert weight >= 0, "invalid weight of %s" % name
+            assert sum(op_mix.values()) > 0, "op mix is empty"
+            assert sum(op_mix.values()) < 0x1_0000_0000, "weights are too large"
+
+        # sequential streams, each in its own region
+        if streams is not None:
+            assert lba_random[0] == d.IOWORKER_LBA_SEQUENTIAL, "streams are sequential"
+            if isinstance(streams, int):
+                end = min(region_end, self.id_data(7, 0))
+                step = (end-region_start)//streams
+                streams = [{'region_start': region_start+i*step,
+                            'region_end': region_start+(i+1)*step} for i in range(streams)]
+            assert 0 < len(streams) <= 64, "support 1-64 streams"
+            streams = [(st['region_start'], st['region_end'], st.get('weight', 1)) for st in streams]
+            for start, end, weight in streams:
+                assert start < end, "invalid stream region"
+                assert weight > 0, "stream weight should be larger than 0"
+            assert sum(st[2] for st in streams) < 0x1_0000_0000, "weights are too large"
+
+        # weighted table of io sizes, buffers are allocated for the largest
+        sizes = None
+        if isinstance(lba_align, dict) and not isinstance(io_size, dict):
+            io_size = {io_size: 1}
+        if isinstance(io_size, dict):
+            assert len(io_size) > 0, "io size table is empty"
+            if not isinstance(lba_align, dict):
+                lba_align = dict.fromkeys(io_size, lba_align)
+            assert all(s in lba_align for s in io_size), "no lba_align of some io size"
+            sizes = [(s, lba_align[s], w) for s, w in io_size.items()]
+            assert sum(w for s, a, w in sizes) < 0x1_0000_0000, "weights are too large"
+            for s, a, w in sizes:
+                assert s>0 and a>0 and w>0, "invalid io size entry"
+            # the region is aligned to every io size
+            io_size = max(s for s, a, w in sizes)
+            lba_align = 1
+            for s, a, w in sizes:
+                lba_align = lba_align*a//math.gcd(lba_align, a)
+            assert lba_align < 0x10000, "alignments of io sizes are too large together"
+
+        # phase schedule
+        if phases is not None:
+            assert len(phases) > 0, "phase schedule is empty"
+            phases = [(int(ph['time']*1000),
+                       ph.get('iops', iops),
+                       ph.get('read_percentage', read_percentage),
+                       ph.get('qdepth', qdepth)) for ph in phases]
+            for mseconds, _iops, _read_percentage, _qdepth in phases:
+                assert mseconds > 0, "phase time should be larger than 0"
+                assert _read_percentage>=0 and _read_percentage<=100, "invalid read percentage in phase"
+                assert _qdepth>0 and _qdepth<=qdepth, "phase qdepth is larger than ioworker qdepth"
+
+        assert not (time==0 and io_count==0 and phases is None), "when to stop the ioworker?"
         assert qdepth>0 and qdepth<=1024, "support qdepth upto 1024"
         assert qdepth <= (self._nvme[0]&0xffff) + 1, "qdepth is larger than specification"  
+        assert verify_threads>=0 and verify_threads<=8, "support verify_threads upto 8"
+        assert seed>=0 and seed<0x1_0000_0000_0000_0000, "seed is a 64-bit unsigned integer"
+        assert core is None or (core>=0 and core<os.cpu_count()), "invalid core"
         
         pciaddr = self._bdf
         nsid = self._nsid
+        if pool is not None:
+            assert pool.pciaddr == pciaddr and pool.nsid == nsid, "pool is of another namespace"
+            assert qdepth+1 <= pool.qdepth, "qdepth is larger than the pool's"
+            assert core is None, "ioworker runs on the core of the pool process"
+        if thread:
+            assert pool is None, "ioworker thread runs in this process"
+            assert core is None, "ioworker thread runs on the cores of this process"
         return _IOWorker(pciaddr, nsid, lba_start, io_size, lba_align,
                          lba_random, region_start, region_end,
                          read_percentage, iops, io_count, time, qdepth+1, qprio,
-                         output_io_per_second, output_percentile_latency)
+                         output_io_per_second, output_percentile_latency,
+                         verify_threads, progress_interval, phases, sizes, streams,
+                         op_mix, seed, pool, core, self if thread else None)
 
     def read(self, qpair, buf, lba, lba_count=1, io_flags=0, cb=None):
         """read IO command
@@ -1570,6 +1886,104 @@ cdef class Namespace(object):
 
         return qpair
 
+    def batch(self, qpair, Buffer buf, ops, lbas, lba_counts, offsets=None, qdepth=64):
+        """send a batch of IO commands in one call, and wait them completed
+
+        Args:
+            qpair (Qpair): use the qpair to send these commands
+            buf (Buffer): the data buffer shared by these commands, meta data is not supported. It can be None when no IO has data.
+            ops (array): the command of each IO, in uint8: 0 read, 1 write, 2 trim, 3 write zeroes, 4 flush, 5 compare
+            lbas (array): the starting lba address of each IO, in uint64
+            lba_counts (array): the lba count of each IO, in uint16
+            offsets (array): the byte offset of the data of each IO in buf, in uint64
+                             default: None, data of IO are laid out back to back in buf
+            qdepth (int): the max number of outstanding commands of the batch
+                          default: 64
+
+        Returns:
+            (DotDict): status (array of uint16) and latency (array of uint32, in us) of each IO, and the number of failed IO in error
+
+        Raises:
+            SystemError: invalid command, or submission fails
+            TimeoutError: no command completes in time
+
+        Notices:
+            numpy arrays and array.array of the same type are used without copy, other sequences are converted.
+            Trim, write zeroes and flush have no data in buf.
+            Outstanding IO should not share the data in buf.
+        """
+
+        cdef const unsigned char[::1] ops_view
+        cdef const unsigned long[::1] lbas_view
+        cdef const unsigned short[::1] lba_counts_view
+        cdef const unsigned long[::1] offsets_view
+        cdef unsigned short[::1] status_view
+        cdef unsigned int[::1] latency_view
+        cdef const unsigned char* ops_ptr
+        cdef const unsigned long* lbas_ptr
+        cdef const unsigned short* lba_counts_ptr
+        cdef const unsigned long* offsets_ptr = NULL
+        cdef unsigned short* status_ptr
+        cdef unsigned int* latency_ptr
+        cdef void* buf_ptr = NULL
+        cdef size_t buf_size = 0
+        cdef d.qpair* q = (<Qpair?>qpair)._qpair
+        cdef unsigned int count = len(ops)
+        cdef unsigned int depth
+        cdef unsigned int timeout = _cTIMEOUT_wrap
+        cdef int ret
+
+        assert len(lbas) == count and len(lba_counts) == count, "arrays are not in the same length"
+        assert offsets is None or len(offsets) == count, "arrays are not in the same length"
+        assert qdepth > 0 and qdepth < 2048, "support qdepth upto 2047"
+        depth = qdepth
+
+        rets = DotDict()
+        rets.status = array.array('H', [0])*count
+        rets.latency = array.array('I', [0])*count
+        rets.error = 0
+        if count == 0:
+            return rets
+
+        ops_view = _batch_array(ops, 'B')
+        lbas_view = _batch_array(lbas, 'Q')
+        lba_counts_view = _batch_array(lba_counts, 'H')
+        if offsets is not None:
+            offsets_view = _batch_array(offsets, 'Q')
+            offsets_ptr = &offsets_view[0]
+        status_view = rets.status
+        latency_view = rets.latency
+        if buf is not None:
+            buf_ptr = buf.ptr
+            buf_size = buf.size
+
+        assert _reentry.flag is False, f"cannot re-entry waitdone() functions which may be caused by waitdone in callback functions, {_reentry.flag}"
+        _reentry.flag = True
+
+        logging.debug("batch of %d io commands, sqid %d" % (count, qpair.sqid))
+        ops_ptr = &ops_view[0]
+        lbas_ptr = &lbas_view[0]
+        lba_counts_ptr = &lba_counts_view[0]
+        status_ptr = &status_view[0]
+        latency_ptr = &latency_view[0]
+        with nogil:
+            ret = d.ns_cmd_batch(self._ns, q, buf_ptr, buf_size, count,
+                                 ops_ptr, lbas_ptr, lba_counts_ptr, offsets_ptr,
+                                 depth, timeout, status_ptr, latency_ptr)
+        _reentry.flag = False
+
+        # buffers are released when all timeout batches are done
+        if _batch_orphans and d.ns_cmd_batch_orphans() == 0:
+            _batch_orphans.clear()
+        if ret == -3:
+            # outstanding IO may still transfer data in the buffer
+            _batch_orphans.append(buf)
+            raise TimeoutError("batch timeout: %d sec" % _cTIMEOUT_wrap)
+        if ret < 0:
+            raise SystemError()
+        rets.error = ret
+        return rets
+
     def dsm(self, qpair, buf, range_count, attribute=0x4, cb=None):
         """data-set management IO command
 
@@ -1746,6 +2160,22 @@ cdef class Namespace(object):
         return ret
 
 
+# buffers of timeout batches are kept for late completions
+_batch_orphans = []
+
+
+def _batch_array(a, typecode):
+    # contiguous arrays of the same unsigned type are used without copy
+    try:
+        m = memoryview(a)
+        if m.ndim == 1 and m.c_contiguous and m.format[-1:] in "BHILQ" and \
+           m.itemsize == array.array(typecode).itemsize:
+            return a
+    except TypeError:
+        pass
+    return array.array(typecode, a)
+
+
 class DotDict(dict):
     """utility class to access dict members by . operation"""
     def __init__(self, *args, **kwargs):
@@ -1753,52 +2183,399 @@ class DotDict(dict):
         self.__dict__ = self
 
 
+cdef class _SharedArray:
+    """read-only array in shared memory, exposed without copy by buffer protocol"""
+
+    cdef object _owner
+    cdef void* _ptr
+    cdef Py_ssize_t _shape[1]
+    cdef Py_ssize_t _itemsize
+    cdef bytes _format
+
+    def __getbuffer__(self, Py_buffer* buffer, int flags):
+        if flags & PyBUF_WRITABLE:
+            raise BufferError("ioworker output is read-only")
+
+        buffer.buf = self._ptr
+        buffer.obj = self
+        buffer.len = self._shape[0]*self._itemsize
+        buffer.readonly = 1
+        buffer.itemsize = self._itemsize
+        buffer.format = self._format
+        buffer.ndim = 1
+        buffer.shape = self._shape
+        buffer.strides = &self._itemsize
+        buffer.suboffsets = NULL
+        buffer.internal = NULL
+
+    def __releasebuffer__(self, Py_buffer* buffer):
+        pass
+
+
+cdef _shared_array(owner, void* ptr, Py_ssize_t count, Py_ssize_t itemsize, bytes format):
+    # the array keeps its owner, so the shared memory lives with the view
+    cdef _SharedArray a = _SharedArray()
+    a._owner = owner
+    a._ptr = ptr
+    a._shape[0] = count
+    a._itemsize = itemsize
+    a._format = format
+    return memoryview(a)
+
+
+cdef class _IOWorkerOutput:
+    """output data of an ioworker in shared memory, filled by the ioworker process"""
+
+    cdef d.ioworker_output* _out
+    cdef bytes _name
+    cdef bint _owner
+
+    def __cinit__(self, name, unsigned int seconds=0, bint create=True):
+        self._name = name.encode('ascii')
+        self._owner = create
+        if create:
+            self._out = d.ioworker_output_init(self._name, seconds)
+        else:
+            self._out = d.ioworker_output_find(self._name)
+        assert self._out is not NULL, "fail to get ioworker output memory"
+
+    def __dealloc__(self):
+        if self._owner and self._out is not NULL:
+            d.ioworker_output_fini(self._name)
+
+    def __reduce__(self):
+        # ioworker process finds the same shared memory by its name
+        return (_IOWorkerOutput, (self._name.decode('ascii'), 0, False))
+
+    def set_percentiles(self, percentiles):
+        assert len(percentiles) <= d.IOWORKER_PERCENTILE_MAX, "too many percentiles"
+        for i, k in enumerate(percentiles):
+            assert k>0 and k<100, "percentile should be in (0, 100)"
+            self._out.percentiles[i] = k
+        self._out.percentile_count = len(percentiles)
+
+    def set_phases(self, phases, once):
+        assert len(phases) <= d.IOWORKER_PHASE_MAX, "too many phases"
+        for i, (mseconds, iops, read_percentage, qdepth) in enumerate(phases):
+            self._out.phases[i].mseconds = mseconds
+            self._out.phases[i].iops = iops
+            self._out.phases[i].read_percentage = read_percentage
+            self._out.phases[i].qdepth = qdepth
+        self._out.phase_count = len(phases)
+        self._out.phase_once = once
+
+    def phases(self):
+        ret = []
+        for i in range(self._out.phase_count):
+            phase = DotDict(self._out.phases[i])
+            io_count = phase.io_count_read + phase.io_count_write
+            phase['latency_average_ns'] = phase.latency_sum_ns//io_count if io_count else 0
+            ret.append(phase)
+        return ret
+
+    def set_sizes(self, sizes):
+        assert len(sizes) <= d.IOWORKER_SIZE_MAX, "too many io sizes"
+        for i, (lba_size, lba_align, weight) in enumerate(sizes):
+            self._out.sizes[i].lba_size = lba_size
+            self._out.sizes[i].lba_align = lba_align
+            self._out.sizes[i].weight = weight
+        self._out.size_count = len(sizes)
+
+    def sizes(self, mseconds):
+        ret = []
+        for i in range(self._out.size_count):
+            size = DotDict(self._out.sizes[i])
+            size['latency_average_ns'] = size.latency_sum_ns//size.io_count if size.io_count else 0
+            size['bandwidth'] = size.io_bytes*1000//mseconds if mseconds else 0
+            ret.append(size)
+        return ret
+
+    def set_streams(self, streams):
+        assert len(streams) <= d.IOWORKER_STREAM_MAX, "too many streams"
+        for i, (region_start, region_end, weight) in enumerate(streams):
+            self._out.streams[i].region_start = region_start
+            self._out.streams[i].region_end = region_end
+            self._out.streams[i].weight = weight
+        self._out.stream_count = len(streams)
+
+    def streams(self):
+        return [DotDict(self._out.streams[i]) for i in range(self._out.stream_count)]
+
+    def set_ops(self, weights):
+        assert len(weights) == d.IOWORKER_OP_MAX
+        for i, weight in enumerate(weights):
+            self._out.ops[i].weight = weight
+
+    cdef void set_args(self, d.ioworker_args* args):
+        args.ops = &self._out.ops[0]
+        args.stream_count = self._out.stream_count
+        args.streams = &self._out.streams[0]
+        args.size_count = self._out.size_count
+        args.sizes = &self._out.sizes[0]
+        args.phase_count = self._out.phase_count
+        args.phase_once = self._out.phase_once
+        args.phases = &self._out.phases[0]
+        args.latency_read = &self._out.latency_read
+        args.latency_write = &self._out.latency_write
+        args.percentile_count = self._out.percentile_count
+        args.percentiles = &self._out.percentiles[0]
+        args.percentile_latency_ns = &self._out.percentile_latency_ns[0]
+        if self._out.seconds != 0:
+            args.io_counter_per_second = &self._out.io_counter_per_second[0]
+
+    @property
+    def io_per_second(self):
+        return _shared_array(self, &self._out.io_counter_per_second[0],
+                             self._out.seconds, sizeof(unsigned int), b"I")
+
+    @property
+    def latency_read(self):
+        return _shared_array(self, &self._out.latency_read.bucket[0],
+                             d.IOWORKER_LATENCY_BUCKETS, sizeof(unsigned long), b"L")
+
+    @property
+    def latency_write(self):
+        return _shared_array(self, &self._out.latency_write.bucket[0],
+                             d.IOWORKER_LATENCY_BUCKETS, sizeof(unsigned long), b"L")
+
+    def percentile_latency(self):
+        return {self._out.percentiles[i]: self._out.percentile_latency_ns[i]/1000
+                for i in range(self._out.percentile_count)}
+
+    def latency_distribution(self):
+        """group read and write latency to 100 groups upto 99% latency"""
+
+        cdef d.ioworker_latency* latency_all
+        cdef unsigned long end99
+
+        latency_all = <d.ioworker_latency*>PyMem_Malloc(sizeof(d.ioworker_latency))
+        memset(latency_all, 0, sizeof(d.ioworker_latency))
+        d.ioworker_latency_merge(latency_all, &self._out.latency_read)
+        d.ioworker_latency_merge(latency_all, &self._out.latency_write)
+        end99 = d.ioworker_latency_percentile(latency_all, 99)//1000
+        unit = max(1, (end99+99)//100)
+        grouped = [0]*100
+        for i in range(d.IOWORKER_LATENCY_BUCKETS):
+            if latency_all.bucket[i]:
+                g = d.ioworker_latency_bucket_ns(i)//1000//unit
+                if g < 100:
+                    grouped[g] += latency_all.bucket[i]
+        PyMem_Free(latency_all)
+        logging.debug(f"end: {end99}, unit: {unit}")
+        return unit, grouped
+
+
+cdef class _IOWorkerProgress:
+    """telemetry of an ioworker in shared memory, published by the ioworker process"""
+
+    cdef void* _progress
+    cdef bytes _name
+    cdef bint _owner
+
+    def __cinit__(self, name, bint create=True):
+        self._name = name.encode('ascii')
+        self._owner = create
+        if create:
+            self._progress = d.ioworker_progress_init(self._name)
+        else:
+            self._progress = d.ioworker_progress_find(self._name)
+        assert self._progress is not NULL, "fail to get ioworker progress memory"
+
+    def __dealloc__(self):
+        if self._owner and self._progress is not NULL:
+            d.ioworker_progress_fini(self._name)
+
+    def __reduce__(self):
+        # ioworker process finds the same shared memory by its name
+        return (_IOWorkerProgress, (self._name.decode('ascii'), False))
+
+    cdef void set_args(self, d.ioworker_args* args, unsigned int interval):
+        args.progress = self._progress
+        args.progress_interval_ms = interval
+
+    def read(self):
+        cdef d.ioworker_progress snapshot
+        d.ioworker_progress_read(self._progress, &snapshot)
+        return DotDict(snapshot)
+
+
+cdef _ioworker_args(d.ioworker_args* args, wid, lba_start, lba_size,
+                    lba_align, lba_random, region_start, region_end,
+                    read_percentage, iops, io_count, time, qdepth,
+                    _IOWorkerOutput output, verify_threads,
+                    _IOWorkerProgress telemetry, progress_interval, seed):
+    memset(args, 0, sizeof(d.ioworker_args))
+    assert lba_size < 0x10000, "io_size is a 16bit-field in commands"
+
+    # output data are written to shared memory directly
+    if output is not None:
+        output.set_args(args)
+    if telemetry is not None:
+        telemetry.set_args(args, progress_interval)
+
+    # transfer agurments
+    args.lba_start = lba_start
+    args.lba_size = lba_size
+    args.lba_align = lba_align
+    (args.lba_random, args.lba_theta,
+     args.lba_hot_fraction, args.lba_hot_probability,
+     args.lba_center, args.lba_sigma) = lba_random
+    args.region_start = region_start
+    args.region_end = region_end
+    args.read_percentage = read_percentage
+    args.iops = iops
+    args.io_count = io_count
+    args.seconds = time
+    args.qdepth = qdepth
+    args.wid = wid
+    args.verify_threads = verify_threads
+    args.seed = seed
+
+
+def _numa_cores(pciaddr):
+    """cores on the NUMA node of the device, or all cores if the node is unknown"""
+    try:
+        with open(f"/sys/bus/pci/devices/0000:{pciaddr.decode()}/numa_node") as f:
+            node = int(f.read())
+        with open(f"/sys/devices/system/node/node{node}/cpulist") as f:
+            cpulist = f.read().strip()
+    except (OSError, ValueError):
+        return list(range(os.cpu_count()))
+
+    cores = []
+    for r in cpulist.split(','):
+        first, _, last = r.partition('-')
+        cores += range(int(first), int(last or first)+1)
+    return cores
+
+
+def _core_alloc(pciaddr, core=None):
+    """allocate the given core, or a free core close to the device"""
+    if core is None:
+        # cores of the device's NUMA node first, and not the main process's
+        used = _core_table | os.sched_getaffinity(0)
+        local = _numa_cores(pciaddr)
+        candidates = local + [c for c in range(os.cpu_count()) if c not in local]
+        core = next((c for c in candidates if c not in used), None)
+        if core is None:
+            logging.warning("no free core for the ioworker")
+            return -1
+    _core_table.add(core)
+    return core
+
+
+def _core_free(core):
+    _core_table.discard(core)
+
+
+def _process_start(p, core):
+    """start the process on the core, which is picked up in driver_init()"""
+    if core >= 0:
+        os.environ["PYNVME_CORE"] = str(core)
+    try:
+        p.start()
+    finally:
+        os.environ.pop("PYNVME_CORE", None)
+
+
+_core_table = set()
+
+
 class _IOWorker(object):
-    """A process-worker executing user functions. Use its wrapper function Namespace.ioworker() in scripts. """
+    """A process-worker, or a thread-worker, executing user functions. Use its wrapper function Namespace.ioworker() in scripts. """
 
     # TODO: max ioworkers = ctrlr->opts.num_io_queues
     _MAX_IOWORKERS = 64
     _id_table = [False] * _MAX_IOWORKERS
+    _output_count = 0
+    _op_names = ('read', 'write', 'trim', 'write_zeroes', 'flush', 'compare')
 
     def __init__(self, pciaddr, nsid, lba_start, lba_size, lba_align,
                  lba_random, region_start, region_end,
                  read_percentage, iops, io_count, time, qdepth, qprio,
-                 output_io_per_second, output_percentile_latency):
+                 output_io_per_second, output_percentile_latency,
+                 verify_threads, progress_interval, phases, sizes, streams,
+                 op_mix, seed, pool, core, namespace):
         # find the new worker id
         self.wid = next((i for i, x in enumerate(_IOWorker._id_table) if x==False), None)
         assert self.wid!=None and self.wid<_IOWorker._MAX_IOWORKERS, "cannot get valid worker id"
         logging.debug("created worker id %d" % self.wid)
         _IOWorker._id_table[self.wid] = True
 
-        # queue for returning result
-        self.q = _mp.Queue()
-
-        # create the child process
-        self.p = _mp.Process(target = self._ioworker,
-                             args = (self.q, self.wid, pciaddr, nsid,
-                                     lba_start, lba_size, lba_align, lba_random,
-                                     region_start, region_end, read_percentage,
-                                     iops, io_count, time, qdepth, qprio,
-                                     output_io_per_second, output_percentile_latency))
+        # queue for returning result, or the queue of the pool process
+        if namespace is not None:
+            self.q = queue.Queue()
+        elif pool is None:
+            self.q = _mp.Queue()
+        else:
+            self.q = None
+
+        # run the whole schedule once by default, and stop at its end
+        phase_once = (phases is not None and time == 0 and io_count == 0)
+        if phase_once:
+            time = (sum(ph[0] for ph in phases)+999)//1000
+
+        # output arrays are filled by the child process in shared memory,
+        # which is reserved only when the ioworker needs it
+        if output_io_per_second is not None:
+            assert time != 0, "need time duration to collect io counter per second data"
+        _IOWorker._output_count += 1
+        self.output = None
+        if (output_io_per_second is not None or
+            output_percentile_latency is not None or
+            phases is not None or sizes is not None or
+            streams is not None or op_mix is not None):
+            self.output = _IOWorkerOutput(f"ioworker_out_{os.getpid()}_{_IOWorker._output_count}",
+                                          time if output_io_per_second is not None else 0)
+        if output_percentile_latency is not None:
+            self.output.set_percentiles(list(output_percentile_latency))
+        if phases is not None:
+            self.output.set_phases(phases, phase_once)
+        if sizes is not None:
+            self.output.set_sizes(sizes)
+        if streams is not None:
+            self.output.set_streams(streams)
+        if op_mix is not None:
+            self.output.set_ops([op_mix.get(name, 0) for name in _IOWorker._op_names])
+        self._telemetry = None
+        if progress_interval != 0:
+            self._telemetry = _IOWorkerProgress(f"ioworker_prog_{os.getpid()}_{_IOWorker._output_count}")
+
+        # create the child process, a reactor may run the workload instead
+        self._params = (self.wid, pciaddr, nsid,
+                        lba_start, lba_size, lba_align, lba_random,
+                        region_start, region_end, read_percentage,
+                        iops, io_count, time, qdepth, qprio,
+                        self.output, verify_threads,
+                        self._telemetry, progress_interval, seed)
         self.output_io_per_second = output_io_per_second
         self.output_percentile_latency = output_percentile_latency
-        self.p.daemon = True
+        self.pool = pool
+        self.core = core
+        self._core = -1
+        self.p = None
+        if namespace is not None:
+            self.p = threading.Thread(target = self._ioworker_thread,
+                                      args = (namespace,))
+            self.p.daemon = True
+        elif pool is None:
+            self.p = _mp.Process(target = self._ioworker,
+                                 args = (self.q,) + self._params)
+            self.p.daemon = True
 
     def start(self):
         """Start the worker's process"""
         logging.debug("start ioworker")
-        self.p.start()
+        if self.pool is not None:
+            self.pool._dispatch(self)
+        elif isinstance(self.p, threading.Thread):
+            self.p.start()
+        else:
+            pciaddr = self._params[1]
+            self._core = _core_alloc(pciaddr, self.core)
+            _process_start(self.p, self._core)
         return self
 
-    def find_percentile_latency(self, k, output_io_per_latency):
-        target = sum(output_io_per_latency) * k // 100
-        total = 0
-        for l, c in enumerate(output_io_per_latency):
-            total += c
-            if total >= target:
-                return l
-        assert False, "should find the latency in the loop"
-
     @property
     def progress(self):
         """get the ioworker progress
@@ -1810,6 +2587,20 @@ class _IOWorker(object):
         status = d.ioworker_get_status(self.wid)
         return self.wid, status.io_count_sent, status.io_count_cplt
 
+    @property
+    def telemetry(self):
+        """get the latest telemetry published by the ioworker
+
+        The ioworker publishes its telemetry in every progress_interval
+        milli-seconds, and at the end of the test.
+
+        Rets:
+            dict of mseconds, iops, iops_read, iops_write, bandwidth (bytes per second), io_count_read, io_count_write, latency_p50_ns, latency_p99_ns, latency_max_ns, error, and finished. IOPS, bandwidth and latency are of the latest interval.
+        """
+
+        assert self._telemetry is not None, "telemetry is not published when progress_interval is 0"
+        return self._telemetry.read()
+
     def close(self):
         """Wait the worker's process finish
 
@@ -1817,9 +2608,13 @@ class _IOWorker(object):
         """
 
         # get data from queue before joinging the subprocess, otherwise deadlock
-        error, rets, output_io_per_second, output_io_per_latency = self.q.get()
+        error, rets = self.q.get()
         rets = DotDict(rets)
-        self.p.join()
+        if self.pool is not None:
+            self.pool._release(self, error)
+        else:
+            self.p.join()
+            _core_free(self._core)
         logging.debug("ioworker closed")
 
         if error != 0:
@@ -1828,34 +2623,28 @@ class _IOWorker(object):
             warnings.warn("ioworker device ERROR status: %02x/%02x" %
                           ((rets.error>>8)&0x7, rets.error&0xff))
 
-        # transfer output table back: driver => script
+        # transfer output table back: shared memory => script
         if self.output_io_per_second is not None:
             assert len(self.output_io_per_second) == 0
-            self.output_io_per_second += output_io_per_second
+            self.output_io_per_second += self.output.io_per_second
             rets['iops_consistency'] = self.iops_consistency()
 
-        # transfer output table back: driver => script
-        if output_io_per_latency is not None:
-            # latency average
-            latency_sum = 0
-            for us, num in enumerate(output_io_per_latency):
-                latency_sum += us*num
-            rets['latency_average_us'] = latency_sum//sum(output_io_per_latency)
-
-            # distribution, group to 100 groups
-            end99 = self.find_percentile_latency(99, output_io_per_latency)
-            unit = (end99+99)//100
-            output_io_per_latency_grouped = []
-            for i in range(0, unit*100, unit):
-                output_io_per_latency_grouped.append(sum(output_io_per_latency[i:i+unit]))
-            logging.debug(f"end: {end99}, unit: {unit}")
+        # transfer output table back: shared memory => script
+        rets['latency_average_us'] = rets.latency_average_ns//1000
+        rets['phases'] = self.output.phases() if self.output is not None else []
+        rets['io_sizes'] = self.output.sizes(rets.mseconds) if self.output is not None else []
+        rets['streams'] = self.output.streams() if self.output is not None else []
+        ops = DotDict()
+        for name, op in zip(_IOWorker._op_names, rets.ops):
+            op = DotDict(op)
+            op['latency_average_ns'] = op.latency_sum_ns//op.io_count if op.io_count else 0
+            ops[name] = op
+        rets['ops'] = ops
+        if self.output_percentile_latency is not None:
+            unit, grouped = self.output.latency_distribution()
             rets['latency_distribution_grouped_unit_us'] = unit
-            rets['latency_distribution_grouped'] = output_io_per_latency_grouped
-
-            # calculate percentile latencies
-            for i, k in enumerate(self.output_percentile_latency):
-                assert k>0 and k<100, "percentile should be in (0, 100)"
-                self.output_percentile_latency[k] = self.find_percentile_latency(k, output_io_per_latency)
+            rets['latency_distribution_grouped'] = grouped
+            self.output_percentile_latency.update(self.output.percentile_latency())
 
         # release the worker id
         if self.wid != None:
@@ -1886,11 +2675,11 @@ class _IOWorker(object):
     def _ioworker(self, rqueue, wid, pciaddr, nsid, lba_start, lba_size,
                   lba_align, lba_random, region_start, region_end,
                   read_percentage, iops, io_count, time, qdepth, qprio,
-                  output_io_per_second, output_percentile_latency):
+                  _IOWorkerOutput output, verify_threads,
+                  _IOWorkerProgress telemetry, progress_interval, seed):
         cdef d.ioworker_args args
         cdef d.ioworker_rets rets
         cdef int error = 0
-        output_io_per_latency = None
 
         try:
             # register events in worker's processor
@@ -1901,34 +2690,12 @@ class _IOWorker(object):
 
             # init var
             _reentry_flag_init()
-            memset(&args, 0, sizeof(args))
             memset(&rets, 0, sizeof(rets))
-            assert lba_size < 0x10000, "io_size is a 16bit-field in commands"
-
-            # create array for output data: io counter per second
-            if output_io_per_second is not None:
-                assert time != 0, "need time duration to collect io counter per second data"
-                args.io_counter_per_second = <unsigned int*>PyMem_Malloc(time*sizeof(unsigned int))
-                memset(args.io_counter_per_second, 0, time*sizeof(unsigned int))
-
-            # create array for output data: io counter per latency
-            if output_percentile_latency is not None:
-                # 1-1000,000 us, all latency > 1s are counted as 1000,000us
-                args.io_counter_per_latency = <unsigned int*>PyMem_Malloc(1000*1000*sizeof(unsigned int))
-
-            # transfer agurments
-            args.lba_start = lba_start
-            args.lba_size = lba_size
-            args.lba_align = lba_align
-            args.lba_random = lba_random
-            args.region_start = region_start
-            args.region_end = region_end
-            args.read_percentage = read_percentage
-            args.iops = iops
-            args.io_count = io_count
-            args.seconds = time
-            args.qdepth = qdepth
-            args.wid = wid
+            _ioworker_args(&args, wid, lba_start, lba_size, lba_align,
+                           lba_random, region_start, region_end,
+                           read_percentage, iops, io_count, time, qdepth,
+                           output, verify_threads, telemetry,
+                           progress_interval, seed)
 
             # runtime in subprocess
             nvme0 = Controller(pciaddr)
@@ -1938,24 +2705,13 @@ class _IOWorker(object):
             # ioworker main roution
             error = d.ioworker_entry(nvme0n1._ns, qpair._qpair, &args, &rets)
 
-            # transfer back iops counter per second: c => cython
-            if output_io_per_second is not None:
-                for i in range(time):
-                    output_io_per_second.append(args.io_counter_per_second[i])
-
-            # transfer back percentile latency: c => cython
-            if output_percentile_latency is not None:
-                output_io_per_latency = []
-                for i in range(1000*1000):
-                    output_io_per_latency.append(args.io_counter_per_latency[i])
-
         except Exception as e:
             logging.warning(e)
             warnings.warn(e)
             error = -1
         finally:
             # feed return to main process
-            rqueue.put((error, rets, output_io_per_second, output_io_per_latency))
+            rqueue.put((error, rets))
 
             # close resources in right order
             nvme0n1.close()
@@ -1963,11 +2719,332 @@ class _IOWorker(object):
             del nvme0n1
             del nvme0
 
-            if args.io_counter_per_second:
-                PyMem_Free(args.io_counter_per_second)
+    def _ioworker_thread(self, Namespace namespace):
+        cdef d.ioworker_args args
+        cdef d.ioworker_rets rets
+        cdef d.namespace* ns = namespace._ns
+        cdef d.qpair* q
+        cdef Qpair qpair = None
+        cdef int error = 0
+
+        try:
+            (wid, pciaddr, nsid, lba_start, lba_size, lba_align,
+             lba_random, region_start, region_end, read_percentage,
+             iops, io_count, time, qdepth, qprio, output,
+             verify_threads, telemetry, progress_interval, seed) = self._params
+
+            # init var
+            memset(&rets, 0, sizeof(rets))
+            _ioworker_args(&args, wid, lba_start, lba_size, lba_align,
+                           lba_random, region_start, region_end,
+                           read_percentage, iops, io_count, time, qdepth,
+                           output, verify_threads, telemetry,
+                           progress_interval, seed)
+
+            # controller and namespace are shared with the script
+            qpair = Qpair(namespace._nvme, max(2, qdepth), qprio)
+            q = qpair._qpair
+
+            # ioworker main roution, other threads run in the meantime
+            with nogil:
+                error = d.ioworker_entry(ns, q, &args, &rets)
 
-            if args.io_counter_per_latency:
-                PyMem_Free(args.io_counter_per_latency)
+        except Exception as e:
+            logging.warning(e)
+            warnings.warn(e)
+            error = -1
+        finally:
+            # feed return to the script
+            self.q.put((error, rets))
+            qpair = None
+
+
+class Reactor(object):
+    """Reactor class. Run several ioworkers in one process, which polls all their Qpairs on one CPU core.
+
+    Each ioworker still has its own Qpair, statistics and worker id, and its close() returns its result as before. The Qpairs can be of different controllers. The reactor saves CPU cores when the host has more IO queues than cores.
+
+    Args:
+        ioworkers (list): ioworkers created by Namespace.ioworker() but not started
+        budget (int): maximum completions to process in each Qpair in a polling round, so a busy Qpair does not starve the others
+                      default: 8
+        core (int): CPU core to run the reactor
+                    default: None, a free core on the NUMA node of the first ioworker's device
+
+    Rets:
+        reactor instance
+
+    Notice:
+        use it with the statement "with", or start() and close() it explicitly
+    """
+
+    def __init__(self, ioworkers, budget=8, core=None):
+        assert len(ioworkers) > 0, "no ioworker to run"
+        assert budget > 0, "budget should be larger than 0"
+        for w in ioworkers:
+            assert w.pool is None, "ioworker is in a pool"
+            assert not isinstance(w.p, threading.Thread), "ioworker runs in a thread"
+            assert w.p.pid is None, "ioworker has started"
+
+        self.ioworkers = ioworkers
+        self.core = core
+        self._core = -1
+        self.p = _mp.Process(target = _reactor,
+                             args = ([w.q for w in ioworkers],
+                                     [w._params for w in ioworkers],
+                                     budget))
+        self.p.daemon = True
+
+        # ioworkers wait this process in close()
+        for w in ioworkers:
+            w.p = self.p
+
+    def start(self):
+        """Start the reactor's process"""
+        logging.debug("start reactor of %d ioworkers" % len(self.ioworkers))
+        self._core = _core_alloc(self.ioworkers[0]._params[1], self.core)
+        _process_start(self.p, self._core)
+        return self
+
+    def close(self):
+        """Wait all ioworkers finish
+
+        Rets:
+            list of return report data of each ioworker
+        """
+        rets = [w.close() for w in self.ioworkers]
+        _core_free(self._core)
+        return rets
+
+    def __enter__(self):
+        self.start()
+        return self
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        assert exc_value is None, "reactor exits with exception: %s" % exc_value
+        self.close()
+        return True
+
+
+class IOWorkerPool(object):
+    """IOWorkerPool class. Processes initialized in advance to run ioworkers of a namespace.
+
+    Spawning an ioworker process costs seconds to initialize the driver, controller and namespace. Processes of the pool initialize them, and create their Qpairs, only once, and then run ioworkers one after another. Give the pool to Namespace.ioworker() to run the ioworker in the pool.
+
+    Args:
+        nvme (Namespace): namespace of the ioworkers
+        size (int): count of processes in the pool, which is the maximum count of ioworkers running in the same time
+        qdepth (int): queue depth of the Qpair in each process, which is the maximum qdepth of the ioworkers
+                      default: 1024
+        qprio (int): SQ priority of the Qpairs
+                     default: 0
+        cores (list): CPU core of each process
+                      default: None, free cores on the NUMA node of the device
+
+    Notice:
+        use it with the statement "with", or close() it explicitly
+    """
+
+    def __init__(self, Namespace nvme, size, qdepth=1024, qprio=0, cores=None):
+        assert size > 0, "pool size should be larger than 0"
+        assert cores is None or len(cores) == size, "give a core to each process"
+        assert qdepth>1 and qdepth<=1025, "support qdepth upto 1024"
+
+        self.pciaddr = nvme._bdf
+        self.nsid = nvme._nsid
+        self.qdepth = qdepth
+        self._tqueues = [_mp.Queue() for i in range(size)]
+        self._rqueues = [_mp.Queue() for i in range(size)]
+        self._procs = [_mp.Process(target = _ioworker_pool,
+                                   args = (self._tqueues[i], self._rqueues[i],
+                                           self.pciaddr, self.nsid, qdepth, qprio))
+                       for i in range(size)]
+        self._idle = list(range(size))
+        self._busy = {}
+        self._cores = []
+        for i, p in enumerate(self._procs):
+            p.daemon = True
+            self._cores.append(_core_alloc(self.pciaddr, cores[i] if cores else None))
+            _process_start(p, self._cores[i])
+
+        # wait all processes ready
+        for q in self._rqueues:
+            assert q.get() == 0, "fail to initialize pool process"
+        logging.debug("ioworker pool of %d processes is ready" % size)
+
+    def _dispatch(self, ioworker):
+        assert self._idle, "no idle process in the pool, or all processes are retired after errors"
+        i = self._idle.pop(0)
+        self._busy[id(ioworker)] = i
+        ioworker.q = self._rqueues[i]
+        self._tqueues[i].put(ioworker._params)
+
+    def _release(self, ioworker, error=0):
+        i = self._busy.pop(id(ioworker))
+        if error != 0:
+            # the process exits after a failed ioworker, and is not used any more
+            logging.warning("ioworker pool process %d retired for error %d" % (i, error))
+            self._procs[i].join()
+        else:
+            self._idle.append(i)
+
+    def close(self):
+        """stop all processes of the pool"""
+        assert not self._busy, "ioworkers are still running in the pool"
+        for q in self._tqueues:
+            q.put(None)
+        for p in self._procs:
+            p.join()
+        for core in self._cores:
+            _core_free(core)
+        self._procs = []
+        self._cores = []
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        self.close()
+        return False
+
+
+def _ioworker_pool(tqueue, rqueue, pciaddr, nsid, qdepth, qprio):
+    cdef d.ioworker_args args
+    cdef d.ioworker_rets rets
+    cdef Namespace nvme0n1 = None
+    cdef Qpair qpair = None
+    cdef int error
+
+    try:
+        # register events in worker's processor
+        # CTRL-c to exit
+        signal.signal(signal.SIGINT, _interrupt_handler)
+        # timeout
+        signal.signal(signal.SIGALRM, _timeout_signal_handler)
+
+        # runtime in subprocess, kept for all ioworkers
+        _reentry_flag_init()
+        nvme0 = Controller(pciaddr)
+        nvme0n1 = Namespace(nvme0, nsid)
+        qpair = Qpair(nvme0, qdepth, qprio)
+        rqueue.put(0)
+    except Exception as e:
+        logging.warning(e)
+        rqueue.put(-1)
+        return
+
+    try:
+        while True:
+            params = tqueue.get()
+            if params is None:
+                break
+
+            error = 0
+            memset(&rets, 0, sizeof(rets))
+            try:
+                (wid, _pciaddr, _nsid, lba_start, lba_size, lba_align,
+                 lba_random, region_start, region_end, read_percentage,
+                 iops, io_count, time, _qdepth, _qprio, output,
+                 verify_threads, telemetry, progress_interval, seed) = params
+                _ioworker_args(&args, wid, lba_start, lba_size, lba_align,
+                               lba_random, region_start, region_end,
+                               read_percentage, iops, io_count, time, _qdepth,
+                               output, verify_threads, telemetry,
+                               progress_interval, seed)
+                error = d.ioworker_entry(nvme0n1._ns, qpair._qpair, &args, &rets)
+            except Exception as e:
+                logging.warning(e)
+                warnings.warn(e)
+                error = -1
+
+            # feed return to main process, and release shared memory
+            rqueue.put((error, rets))
+            params = output = telemetry = None
+
+            # io of the failed ioworker may be still outstanding in the
+            # qpair, so it cannot run more ioworkers
+            if error != 0:
+                break
+
+    finally:
+        # close resources in right order
+        nvme0n1.close()
+        qpair = None
+        nvme0n1 = None
+        del nvme0
+
+
+def _reactor(rqueues, params, unsigned int budget):
+    cdef unsigned int count = len(params)
+    cdef d.ioworker_args* args = <d.ioworker_args*>PyMem_Malloc(count*sizeof(d.ioworker_args))
+    cdef d.ioworker_rets* rets = <d.ioworker_rets*>PyMem_Malloc(count*sizeof(d.ioworker_rets))
+    cdef d.namespace** ns = <d.namespace**>PyMem_Malloc(count*sizeof(d.namespace*))
+    cdef d.qpair** qpairs = <d.qpair**>PyMem_Malloc(count*sizeof(d.qpair*))
+    cdef int* errors = <int*>PyMem_Malloc(count*sizeof(int))
+    cdef Namespace namespace
+    cdef Qpair qpair
+    controllers = {}
+    namespaces = {}
+    qpair_list = []
+
+    try:
+        # register events in reactor's processor
+        # CTRL-c to exit
+        signal.signal(signal.SIGINT, _interrupt_handler)
+        # timeout
+        signal.signal(signal.SIGALRM, _timeout_signal_handler)
+
+        # init var
+        _reentry_flag_init()
+        memset(rets, 0, count*sizeof(d.ioworker_rets))
+        for i in range(count):
+            errors[i] = -1
+
+        # runtime in subprocess, controllers and namespaces are shared
+        for i, (wid, pciaddr, nsid, lba_start, lba_size, lba_align,
+                lba_random, region_start, region_end, read_percentage,
+                iops, io_count, time, qdepth, qprio, output, verify_threads,
+                telemetry, progress_interval, seed) in enumerate(params):
+            _ioworker_args(&args[i], wid, lba_start, lba_size, lba_align,
+                           lba_random, region_start, region_end,
+                           read_percentage, iops, io_count, time, qdepth,
+                           output, verify_threads, telemetry,
+                           progress_interval, seed)
+            if pciaddr not in controllers:
+                controllers[pciaddr] = Controller(pciaddr)
+            if (pciaddr, nsid) not in namespaces:
+                namespaces[(pciaddr, nsid)] = Namespace(controllers[pciaddr], nsid)
+            namespace = namespaces[(pciaddr, nsid)]
+            qpair = Qpair(controllers[pciaddr], max(2, qdepth), qprio)
+            qpair_list.append(qpair)
+            ns[i] = namespace._ns
+            qpairs[i] = qpair._qpair
+
+        # poll all qpairs till every ioworker finishes
+        d.ioworker_reactor(count, ns, qpairs, args, rets, errors, budget)
+
+    except Exception as e:
+        logging.warning(e)
+        warnings.warn(e)
+
+    finally:
+        # feed return to main process
+        for i, q in enumerate(rqueues):
+            q.put((errors[i], rets[i]))
+
+        # close resources in right order
+        for namespace in namespaces.values():
+            namespace.close()
+        namespace = None
+        qpair = None
+        del qpair_list
+        del namespaces
+        del controllers
+        PyMem_Free(errors)
+        PyMem_Free(qpairs)
+        PyMem_Free(ns)
+        PyMem_Free(rets)
+        PyMem_Free(args)
 
 
 # module init, needs root privilege
@@ -1984,8 +3061,8 @@ if os.geteuid() == 0:
     # spawn only limited data from parent process
     _mp = multiprocessing.get_context("spawn")
 
-    # init driver
-    if d.driver_init() != 0:
+    # init driver, on the core given by the parent process
+    if d.driver_init(int(os.environ.get("PYNVME_CORE", -1))) != 0:
         raise SystemExit("driver initialization fail")
 
     # module fini